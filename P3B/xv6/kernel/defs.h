@@ -128,6 +128,7 @@ void*           memmove(void*, const void*, uint);
 void*           memset(void*, int, uint);
 char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
+uint            strnlen(const char*, uint);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
@@ -137,6 +138,9 @@ int             argptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(struct proc*, uint, int*);
 int             fetchstr(struct proc*, uint, char**);
+uint            uspan(struct proc*, uint);
+int             copyin(struct proc*, void*, uint, uint);
+int             copyinstr(struct proc*, char*, uint, int);
 void            syscall(void);
 
 // timer.c
@@ -99,3 +99,15 @@ strlen(const char *s)
   return n;
 }
 
+// Length of s, looking at no more than n bytes;
+// n if there is no nul among them.
+uint
+strnlen(const char *s, uint n)
+{
+  uint i;
+
+  for(i = 0; i < n && s[i]; i++)
+    ;
+  return i;
+}
+
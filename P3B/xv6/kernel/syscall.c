@@ -13,11 +13,28 @@
 // library system call function. The saved user %esp points
 // to a saved program counter, and then the first argument.
 
+// User memory is two runs of whole pages: text, data and heap
+// from PGSIZE up to sz, and the stack from stack_top up to
+// USERTOP, with at least an unmapped guard page between them.
+// Return how many bytes of p's memory there are from addr to the
+// end of the run holding it, or 0 if addr is not user memory.
+// Any range that fits is mapped, so the kernel, which runs with
+// p's page table, can use it directly.
+uint
+uspan(struct proc *p, uint addr)
+{
+  if(addr >= PGSIZE && addr < PGROUNDUP(p->sz))
+    return PGROUNDUP(p->sz) - addr;
+  if(addr >= p->stack_top && addr < USERTOP)
+    return USERTOP - addr;
+  return 0;
+}
+
 // Fetch the int at addr from process p.
 int
 fetchint(struct proc *p, uint addr, int *ip)
 {
-  if(addr >= p->sz || addr+4 > p->sz)
+  if(uspan(p, addr) < 4)
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -29,16 +46,39 @@ fetchint(struct proc *p, uint addr, int *ip)
 int
 fetchstr(struct proc *p, uint addr, char **pp)
 {
-  char *s, *ep;
+  uint n, len;
 
-  if(addr >= p->sz)
+  if((n = uspan(p, addr)) == 0)
+    return -1;
+  len = strnlen((char*)addr, n);
+  if(len == n)
     return -1;
   *pp = (char*)addr;
-  ep = (char*)p->sz;
-  for(s = *pp; s < ep; s++)
-    if(*s == 0)
-      return s - *pp;
-  return -1;
+  return len;
+}
+
+// Copy n bytes from addr in process p to dst.
+int
+copyin(struct proc *p, void *dst, uint addr, uint n)
+{
+  if(uspan(p, addr) < n)
+    return -1;
+  memmove(dst, (char*)addr, n);
+  return 0;
+}
+
+// Copy the string at addr in process p, with its nul, to dst,
+// which has room for max bytes.  Return its length.
+int
+copyinstr(struct proc *p, char *dst, uint addr, int max)
+{
+  char *s;
+  int n;
+
+  if((n = fetchstr(p, addr, &s)) < 0 || n >= max)
+    return -1;
+  memmove(dst, s, n+1);
+  return n;
 }
 
 // Fetch the nth 32-bit system call argument.
@@ -58,24 +98,9 @@ argptr(int n, char **pp, int size)
   
   if(argint(n, &i) < 0)
     return -1;
-  /*******PART B MOD.6 ********************************************/
-  /*change the code to check that the arg is inside valid allocated*/
-  /*virtual memory of the process
-  *4 CASES:
-  *POINTER STARTS IN FIRST UNALLOCATED PAGE
-  *POINTER STARTS IN BUFFER UNALLOCATED PAGE BETWEEN HEAP & STACK
-  *POINTER STARTS IN CODE/HEAP BUT SPILLS OVER INTO UNALLOCATED BUFFER
-  *POINTER STARTS IN STACK BUT SPILLS OVER INTO UNALLOCATED VIRTUAL MEMORY SPACE (SEG FAULT)
-  */ 
-  if((uint)i < PGSIZE || (((uint)i >= proc->sz) && ((uint)i < proc->stack_top)) ||  (uint)i+size > proc->sz || (uint)i+size > USERTOP )
-    return -1;
-
-  /*************************/
-   
-  /*OG CODE TO COMPARE
-  if((uint)i >= proc->sz || (uint)i+size > proc->sz)
+  // The block must lie within the heap or within the stack.
+  if(size < 0 || uspan(proc, (uint)i) < size)
     return -1;
-  */
   *pp = (char*)i;
   return 0;
 }
@@ -344,27 +344,49 @@ sys_chdir(void)
 int
 sys_exec(void)
 {
-  char *path, *argv[MAXARG];
-  int i;
-  uint uargv, uarg;
+  char *buf, *path, *argv[MAXARG], *s, *e;
+  int i, n, len, r;
+  uint upath, uargv, uargs[MAXARG];
 
-  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0){
+  if(argint(0, (int*)&upath) < 0 || argint(1, (int*)&uargv) < 0){
     return -1;
   }
-  memset(argv, 0, sizeof(argv));
+  // Copy in all the argument pointers that could be there at
+  // once; the terminating 0 must be among them.
+  n = uspan(proc, uargv) / sizeof(uargs[0]);
+  if(n > NELEM(uargs))
+    n = NELEM(uargs);
+  if(copyin(proc, uargs, uargv, n*sizeof(uargs[0])) < 0)
+    return -1;
+
+  // Copy the path and argument strings into one kernel page;
+  // they must fit in the new stack page anyway.
+  if((buf = kalloc()) == 0)
+    return -1;
+  s = buf;
+  e = buf + PGSIZE;
+  r = -1;
+  if((len = copyinstr(proc, s, upath, e - s)) < 0)
+    goto out;
+  path = s;
+  s += len + 1;
   for(i=0;; i++){
-    if(i >= NELEM(argv))
-      return -1;
-    if(fetchint(proc, uargv+4*i, (int*)&uarg) < 0)
-      return -1;
-    if(uarg == 0){
+    if(i >= n)
+      goto out;
+    if(uargs[i] == 0){
       argv[i] = 0;
       break;
     }
-    if(fetchstr(proc, uarg, &argv[i]) < 0)
-      return -1;
+    if((len = copyinstr(proc, s, uargs[i], e - s)) < 0)
+      goto out;
+    argv[i] = s;
+    s += len + 1;
   }
-  return exec(path, argv);
+  r = exec(path, argv);
+
+out:
+  kfree(buf);
+  return r;
 }
 
 int
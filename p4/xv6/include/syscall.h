@@ -25,5 +25,7 @@
 #define SYS_uptime 21
 #define SYS_clone  22 // MOD.15
 #define SYS_join   23 // MOD.16
+#define SYS_futex_wait 24
+#define SYS_futex_wake 25
 
 #endif // _SYSCALL_H_
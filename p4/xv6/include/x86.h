@@ -139,6 +139,30 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// If *addr is old, make it new.  Return what *addr was.
+static inline uint
+cmpxchg(volatile uint *addr, uint old, uint new)
+{
+  uint prev;
+
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (prev), "+m" (*addr) :
+               "r" (new), "0" (old) :
+               "cc", "memory");
+  return prev;
+}
+
+// Add v to *addr.  Return what *addr was.
+static inline uint
+fetchadd(volatile uint *addr, uint v)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (v), "+m" (*addr) :
+               :
+               "cc", "memory");
+  return v;
+}
+
 static inline void
 lcr0(uint val)
 {
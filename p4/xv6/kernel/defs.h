@@ -52,6 +52,11 @@ int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint*, uint);
+int             futexwake(uint*, int);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
@@ -112,7 +117,7 @@ void            yield(void);
 // MOD.7
 int		clone(void(*fnc)(void*), void*, void*);
 // MOD.8
-int		join(int);
+int		join(int, void**);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
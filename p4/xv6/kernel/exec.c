@@ -11,7 +11,7 @@ exec(char *path, char **argv)
 {
   char *s, *last;
   int i, off;
-  uint argc, sz, sp, ustack[3+MAXARG+1];
+  uint argc, sz, sp, tls, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
@@ -53,8 +53,14 @@ exec(char *path, char **argv)
   if((sz = allocuvm(pgdir, sz, sz + PGSIZE)) == 0)
     goto bad;
 
+  // The top of the stack page is the TLS block, whose first
+  // word points at itself.
+  tls = sz - TLSSIZE;
+  if(copyout(pgdir, tls, &tls, sizeof(tls)) < 0)
+    goto bad;
+
   // Push argument strings, prepare rest of stack in ustack.
-  sp = sz;
+  sp = tls;
   for(argc = 0; argv[argc]; argc++) {
     if(argc >= MAXARG)
       goto bad;
@@ -86,6 +92,8 @@ exec(char *path, char **argv)
   proc->sz = sz;
   proc->tf->eip = elf.entry;  // main
   proc->tf->esp = sp;
+  proc->tf->gs = (SEG_UTLS << 3) | DPL_USER;
+  proc->tls = tls;
   switchuvm(proc);
   freevm(oldpgdir);
 
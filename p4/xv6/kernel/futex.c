@@ -0,0 +1,112 @@
+// Futexes: sleeping on a word of user memory.
+//
+// futexwait(addr, val) sleeps only if *addr still holds val,
+// checked under futex.lock; futexwake(addr, n) wakes up to n of
+// the processes sleeping on addr.  A user lock changes the word
+// before it calls futexwake, so a waiter either sees the new
+// value or is already queued when the waker looks.
+//
+// Threads made by clone() share a page table, so a futex is
+// named by (pgdir, addr).  Waiters are kept in queues hashed by
+// that pair, in the order they arrived.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define NFUTEXQ     64
+#define FUTEXQSHIFT  6   // log2(NFUTEXQ)
+
+struct {
+  struct spinlock lock;
+  struct proc *q[NFUTEXQ];
+} futex;
+
+void
+futexinit(void)
+{
+  initlock(&futex.lock, "futex");
+}
+
+// The queue for the futex at addr in address space pgdir.
+static struct proc**
+futexq(pde_t *pgdir, uint *addr)
+{
+  uint h;
+
+  h = ((uint)pgdir >> PGSHIFT) ^ ((uint)addr >> 2);
+  return &futex.q[(h * 0x9E3779B9) >> (32 - FUTEXQSHIFT)];
+}
+
+// Take p off the queue it is waiting on.
+static void
+futexunlink(struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = futexq(p->pgdir, p->futexaddr); *pp != p; pp = &(*pp)->futexnext)
+    ;
+  *pp = p->futexnext;
+  p->futexnext = 0;
+  p->futexaddr = 0;
+}
+
+// Sleep on addr, a word of the current process's memory, if it
+// holds val.  Return 0 when woken, or -1 at once if *addr != val
+// or if the process is killed while it waits.
+int
+futexwait(uint *addr, uint val)
+{
+  struct proc **pp;
+
+  acquire(&futex.lock);
+  if(*addr != val){
+    release(&futex.lock);
+    return -1;
+  }
+  proc->futexaddr = addr;
+  proc->futexnext = 0;
+  for(pp = futexq(proc->pgdir, addr); *pp; pp = &(*pp)->futexnext)
+    ;
+  *pp = proc;
+  // futexwake clears futexaddr; anything else is a spurious wakeup.
+  while(proc->futexaddr){
+    if(proc->killed){
+      futexunlink(proc);
+      release(&futex.lock);
+      return -1;
+    }
+    sleep(&proc->futexaddr, &futex.lock);
+  }
+  release(&futex.lock);
+  return 0;
+}
+
+// Wake up to n processes sleeping on addr in the current process's
+// address space, oldest first.  Return how many were woken.
+int
+futexwake(uint *addr, int n)
+{
+  struct proc **pp, *p;
+  int woken;
+
+  woken = 0;
+  acquire(&futex.lock);
+  pp = futexq(proc->pgdir, addr);
+  while(woken < n && (p = *pp) != 0){
+    if(p->pgdir != proc->pgdir || p->futexaddr != addr){
+      pp = &p->futexnext;
+      continue;
+    }
+    *pp = p->futexnext;
+    p->futexnext = 0;
+    p->futexaddr = 0;
+    wakeup(&p->futexaddr);
+    woken++;
+  }
+  release(&futex.lock);
+  return woken;
+}
@@ -49,6 +49,7 @@ mainc(void)
   uartinit();      // serial port
   kvmalloc();      // initialize the kernel page table
   pinit();         // process table
+  futexinit();     // futex wait queues
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
@@ -6,6 +6,7 @@ KERNEL_OBJECTS := \
 	exec.o\
 	file.o\
 	fs.o\
+	futex.o\
 	ide.o\
 	ioapic.o\
 	kalloc.o\
@@ -160,6 +160,7 @@ fork(void)
     return -1;
   }
   np->sz = proc->sz;
+  np->tls = proc->tls;
   np->parent = proc;
   np->thread = 0;	// MOD.19
   *np->tf = *proc->tf;
@@ -245,7 +246,8 @@ wait(void)
     // Scan through table looking for zombie children.
     havekids = 0;
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != proc)
+      // Threads share our page table; join reaps them.
+      if(p->parent != proc || p->thread)
         continue;
       havekids = 1;
       if(p->state == ZOMBIE){
@@ -493,7 +495,6 @@ clone(void(*fnc)(void*), void *arg, void *stack)
 				   was added to proc.h */
   
   thread->thread = 1;		// Mark this proc as a thread
-  thread->state  = RUNNABLE;
   
   // Set the parents accordingly
   if(proc->thread)
@@ -516,26 +517,21 @@ clone(void(*fnc)(void*), void *arg, void *stack)
   // Thread will have the same directory as its parent
   thread->cwd = idup(proc->cwd);
 
-  void *stackArgs;
-  void *stackPtr;
+  // The top TLSSIZE bytes of the stack page are the thread's
+  // TLS block, zeroed, with its first word pointing at itself.
+  thread->tls = (uint)stack + PGSIZE - TLSSIZE;
+  memset((void*)thread->tls, 0, TLSSIZE);
+  *(uint *)thread->tls = thread->tls;
+  thread->tf->gs = (SEG_UTLS << 3) | DPL_USER;
 
-  // A page minus the header of said page,
-  // allocated with the arg parameter
-  stackPtr = stack + PGSIZE - (2 * sizeof(void*));
-  *(uint *)stackPtr = 0xffffffff; // Fake return PC
-  
-  stackArgs = stack + PGSIZE - sizeof(void*);
-  *(uint *)stackArgs = (uint)arg;
-
-  thread->tf->esp = (int)stack;
-  
-  // Move the newly allocated thread stack to the thread's
-  // trap frame stack pointer
-  memmove((void*)thread->tf->esp, stack, PGSIZE);
+  // Below it, the argument and a fake return PC,
+  // as if fnc(arg) had just been called
+  thread->tf->esp = thread->tls - 2*sizeof(uint);
+  ((uint *)thread->tf->esp)[0] = 0xffffffff;
+  ((uint *)thread->tf->esp)[1] = (uint)arg;
 
   // Set the trap frame parameters of the new thread, specifically
   // register EIP as the specified entry point of the fnc parameter
-  thread->tf->esp += PGSIZE - (2 * sizeof(void*));
   thread->tf->ebp = thread->tf->esp;
   thread->tf->eip = (uint)(fnc);
 
@@ -544,87 +540,58 @@ clone(void(*fnc)(void*), void *arg, void *stack)
   
   // Set up the thread's process id just before return
   pid = thread->pid;
+
+  // Only now is everything in place for another CPU to run it
+  thread->state = RUNNABLE;
   
   // Go onward little one, make us proud
   return pid;
 }
 
-// Kill the thread by joining it back with its parent process - MOD.2
+// Wait for thread pid of the current process to exit, or for
+// any of its threads if pid is -1.  Store the stack the thread
+// was cloned with in *stack, for the caller to free or reuse,
+// and return the thread's pid.  Return -1 if there is no such
+// thread.  MOD.2
 int
-join(int pid)
+join(int pid, void **stack)
 {
-
-  struct proc *thread;
+  struct proc *p;
   int havekids;
 
   acquire(&ptable.lock);
   for(;;){
-    // Scan through table looking for zombie children.
+    // Scan through table looking for zombie threads.
     havekids = 0;
-
-    for(thread = ptable.proc; thread < &ptable.proc[NPROC]; thread++)
-    {
-      if( thread->parent != proc ||
-      	  thread->pgdir != proc->pgdir ||
-	  thread->pid == proc->pid )
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(!p->thread || p->parent != proc || p->pgdir != proc->pgdir)
+        continue;
+      if(pid != -1 && p->pid != pid)
         continue;
-      
       havekids = 1;
- 
-      if(pid == -1)
-      {
-        if(thread->state == ZOMBIE)
-	{
-
-	   void* stackPtr = (void *)thread->parent->tf->esp + 7*sizeof(void*);
-   	   *(uint *)stackPtr = thread->tf->ebp;
- 	   *(uint *)stackPtr += 3*sizeof(void *) - PGSIZE;
-
-           kfree(thread->kstack);
-           thread->kstack = 0;
-           thread->state = UNUSED;
-           thread->pid = 0;
-           thread->parent = 0;
-           thread->name[0] = 0;
-           thread->killed = 0;
-
-	   // Release the lock so livelock doesn't occur
-           release(&ptable.lock);
-           return pid;
-	}
-      }
-
-      else if(thread->pid == pid)
-      {
-
-	void* stackPtr = (void *)thread->parent->tf->esp + 7*sizeof(void*);
-	*(uint *)stackPtr = thread->tf->ebp;
-	*(uint *)stackPtr += 3*sizeof(void *) - PGSIZE;
-
-        kfree(thread->kstack);
-        thread->kstack = 0;
-        thread->state = UNUSED;
-        thread->pid = 0;
-        thread->parent = 0;
-        thread->name[0] = 0;
-        thread->killed = 0;
-
-	// Release the lock so livelock doesn't occur
+      if(p->state == ZOMBIE){
+        // Found one.  Its memory is ours; free only its kernel stack.
+        pid = p->pid;
+        *stack = p->stack;
+        kfree(p->kstack);
+        p->kstack = 0;
+        p->state = UNUSED;
+        p->pid = 0;
+        p->parent = 0;
+        p->name[0] = 0;
+        p->killed = 0;
         release(&ptable.lock);
         return pid;
-
-
       }
     }
-  
-    // No point waiting if we don't have any children.
+
+    // No point waiting if we don't have any threads.
     if(!havekids || proc->killed){
       release(&ptable.lock);
       return -1;
     }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
+    // Wait for threads to exit.  (See wakeup1 call in proc_exit.)
     sleep(proc, &ptable.lock);  //DOC: wait-sleep
   }
-  return 0;
 }
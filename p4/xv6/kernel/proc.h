@@ -8,7 +8,8 @@
 #define SEG_UCODE 4  // user code
 #define SEG_UDATA 5  // user data+stack
 #define SEG_TSS   6  // this process's task state
-#define NSEGS     7
+#define SEG_UTLS  7  // this thread's TLS block, user %gs
+#define NSEGS     8
 
 // Per-CPU state
 struct cpu {
@@ -66,6 +67,7 @@ struct proc {
   char *kstack;                // Bottom of kernel stack for this process
   void *stack;		       // Address of the proc's stack
   int thread;		       // Tells whether or not the proc is a thread
+  uint tls;                    // Address of TLSSIZE-byte TLS block
   enum procstate state;        // Process state
   volatile int pid;            // Process ID
   struct proc *parent;         // Parent process
@@ -76,6 +78,8 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  uint *futexaddr;             // If non-zero, waiting in futexwait
+  struct proc *futexnext;      // Next waiter on the same futex queue
 };
 
 // Process memory is laid out contiguously, low addresses first:
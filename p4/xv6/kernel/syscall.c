@@ -104,7 +104,9 @@ static int (*syscalls[])(void) = {
 [SYS_write]   sys_write,
 [SYS_uptime]  sys_uptime,
 [SYS_clone]   sys_clone,  // MOD.5
-[SYS_join]    sys_join    // MOD.6
+[SYS_join]    sys_join,   // MOD.6
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
 };
 
 // Called on a syscall trap. Checks that the syscall number (passed via eax)
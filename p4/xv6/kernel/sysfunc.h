@@ -27,5 +27,7 @@ int sys_uptime(void);
 int sys_clone(void);
 // MOD.4
 int sys_join(void);
+int sys_futex_wait(void);
+int sys_futex_wake(void);
 
 #endif // _SYSFUNC_H_
@@ -102,30 +102,54 @@ int sys_clone(void)
   if( argptr(1, (void*)&arg, sizeof(void*)) < 0 )
   	return -1;
   
-  if( argptr(2, (void*)&stack, sizeof(void*)) < 0 )
+  // The whole one-page stack must be in the process's memory
+  if( argptr(2, (void*)&stack, PGSIZE) < 0 )
   	return -1;
   
   // Sanity check on the page boundary
   if( (uint)stack % PGSIZE != 0 )
   	return -1;
 
-  // Process cannot allocate a stack that will
-  // extend beyond the boundary of its size
-  if( (uint)proc->sz - (uint)stack == PGSIZE/2)
-  	return -1;
-
   return clone(fnc, arg, stack);
 
 }
 
 // MOD.10
+// join(pid, &stack): pid -1 joins any thread.
 int sys_join(void)
 {
-  
   int pid;
+  void **stack;
 
-  pid = proc->pid;
+  if(argint(0, &pid) < 0 || argptr(1, (void*)&stack, sizeof(*stack)) < 0)
+    return -1;
+  return join(pid, stack);
+}
 
-  return join(pid);
+// Sleep while the word at addr holds val.
+int
+sys_futex_wait(void)
+{
+  uint *addr;
+  int val;
 
+  if(argptr(0, (void*)&addr, sizeof(*addr)) < 0 || argint(1, &val) < 0)
+    return -1;
+  if((uint)addr % sizeof(*addr) != 0)
+    return -1;
+  return futexwait(addr, val);
+}
+
+// Wake up to n threads sleeping on the word at addr.
+int
+sys_futex_wake(void)
+{
+  uint *addr;
+  int n;
+
+  if(argptr(0, (void*)&addr, sizeof(*addr)) < 0 || argint(1, &n) < 0)
+    return -1;
+  if((uint)addr % sizeof(*addr) != 0)
+    return -1;
+  return futexwake(addr, n);
 }
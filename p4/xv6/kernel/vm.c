@@ -178,6 +178,8 @@ switchuvm(struct proc *p)
   cpu->ts.ss0 = SEG_KDATA << 3;
   cpu->ts.esp0 = (uint)proc->kstack + KSTACKSIZE;
   ltr(SEG_TSS << 3);
+  // User %gs holds SEG_UTLS; trapret reloads it with this base.
+  cpu->gdt[SEG_UTLS] = SEG16(STA_W, p->tls, TLSSIZE-1, DPL_USER);
   if(p->pgdir == 0)
     panic("switchuvm: no pgdir");
   lcr3(PADDR(p->pgdir));  // switch to new address space
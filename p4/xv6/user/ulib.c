@@ -3,6 +3,7 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "param.h"
 
 #define  PGSIZE 4096
 
@@ -105,23 +106,223 @@ memmove(void *vdst, void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+// Thread stacks.  clone wants one page-aligned page, and keeps
+// the top TLSSIZE bytes of it for the thread's TLS block.  Stacks come
+// straight from sbrk, each with a guard page below it, and join
+// hands them back to a free list for the next thread_create, so
+// creating and joining threads does not grow the heap.
+//
+// Nothing can unmap a page in the middle of the heap, so the guard
+// page is a red zone: thread_join checks that the words nearest the
+// stack still hold GUARD, and complains if a thread overran.
+
+#define GUARD    0x57AC57AC
+#define NGUARD   16   // words checked at the top of the guard page
+
+static char *freestacks;       // linked through each stack's first word
+static struct mutex stacklock;
+
+static char*
+stackalloc(void)
+{
+  char *p, *brk;
+  uint *g;
+  int i;
+
+  mutex_lock(&stacklock);
+  if((p = freestacks) != 0){
+    freestacks = *(char**)p;
+    mutex_unlock(&stacklock);
+    return p;
+  }
+  // Pad the break to a page boundary, then take a guard page
+  // and a stack page.
+  brk = sbrk(0);
+  if(sbrk((PGSIZE - (uint)brk % PGSIZE) % PGSIZE) == (char*)-1 ||
+     (p = sbrk(2*PGSIZE)) == (char*)-1){
+    mutex_unlock(&stacklock);
+    return 0;
+  }
+  mutex_unlock(&stacklock);
+  g = (uint*)(p + PGSIZE) - NGUARD;
+  for(i = 0; i < NGUARD; i++)
+    g[i] = GUARD;
+  return p + PGSIZE;
+}
+
+static void
+stackfree(char *stack)
+{
+  uint *g;
+  int i;
+
+  g = (uint*)stack - NGUARD;
+  for(i = 0; i < NGUARD; i++){
+    if(g[i] != GUARD){
+      printf(2, "thread stack 0x%x overflowed\n", stack);
+      g[i] = GUARD;
+    }
+  }
+  mutex_lock(&stacklock);
+  *(char**)stack = freestacks;
+  freestacks = stack;
+  mutex_unlock(&stacklock);
+}
+
 // MOD.17
 int
 thread_create(void(*start_routine)(void*), void *arg) 
 {
-  void *SP;
-  if( (SP = malloc(PGSIZE)) == NULL )
-  {
-  	return -1;
-  }
-  if( (uint)SP % PGSIZE )
-  	SP = SP + (PGSIZE - (uint)SP%PGSIZE);
+  char *stack;
+  int pid;
 
-  return clone(start_routine, arg, SP);
+  if((stack = stackalloc()) == 0)
+    return -1;
+  if((pid = clone(start_routine, arg, stack)) < 0)
+    stackfree(stack);
+  return pid;
 }
-// MOD.18
+
+// Wait for thread pid, or any thread if pid is -1, to exit,
+// and keep its stack for reuse.  MOD.18
 int
 thread_join(int pid)
 { 
-  return join(pid);
+  void *stack;
+
+  if((pid = join(pid, &stack)) < 0)
+    return -1;
+  stackfree(stack);
+  return pid;
+}
+
+// Mutexes, condition variables and semaphores for threads.
+// None of them spin: an uncontended operation is one atomic
+// instruction, and a contended one sleeps in futex_wait.
+
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  uint c;
+
+  if((c = cmpxchg(&m->state, 0, 1)) == 0)
+    return;
+  // Mark the mutex contended, so unlock knows to wake someone.
+  if(c != 2)
+    c = xchg(&m->state, 2);
+  while(c != 0){
+    futex_wait(&m->state, 2);
+    c = xchg(&m->state, 2);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(fetchadd(&m->state, -1) != 1){
+    m->state = 0;
+    futex_wake(&m->state, 1);
+  }
+}
+
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+}
+
+// Unlock m, wait for a signal, and lock m again.
+// Like any condition variable, may return spuriously.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  uint seq;
+
+  seq = c->seq;
+  mutex_unlock(m);
+  futex_wait(&c->seq, seq);
+  mutex_lock(m);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  fetchadd(&c->seq, 1);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  fetchadd(&c->seq, 1);
+  futex_wake(&c->seq, NPROC);
+}
+
+void
+sem_init(struct sem *s, uint count)
+{
+  s->count = count;
+  s->nwait = 0;
+}
+
+void
+sem_wait(struct sem *s)
+{
+  uint c;
+
+  for(;;){
+    c = s->count;
+    if(c > 0){
+      if(cmpxchg(&s->count, c, c-1) == c)
+        return;
+      continue;
+    }
+    fetchadd(&s->nwait, 1);
+    futex_wait(&s->count, 0);
+    fetchadd(&s->nwait, -1);
+  }
+}
+
+void
+sem_post(struct sem *s)
+{
+  fetchadd(&s->count, 1);
+  if(s->nwait)
+    futex_wake(&s->count, 1);
+}
+
+// Thread-local storage.  exec and clone point %gs at the running
+// thread's TLSSIZE-byte block, so each thread sees its own.  Word
+// 0 holds the block's address; words 1 up are the program's.
+
+// This thread's TLS block, as an ordinary pointer.
+void*
+tls(void)
+{
+  void *p;
+
+  asm volatile("movl %%gs:0, %0" : "=r" (p));
+  return p;
+}
+
+// Word i of this thread's TLS block.
+uint
+tlsget(int i)
+{
+  uint v;
+
+  asm volatile("movl %%gs:(,%1,4), %0" : "=r" (v) : "r" (i));
+  return v;
+}
+
+void
+tlsset(int i, uint v)
+{
+  asm volatile("movl %0, %%gs:(,%1,4)" : : "r" (v), "r" (i) : "memory");
 }
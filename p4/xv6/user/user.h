@@ -3,6 +3,20 @@
 
 struct stat;
 
+// Blocking locks for threads, built on futexes (ulib.c).
+struct mutex {
+  volatile uint state;  // 0 free, 1 held, 2 held and maybe waited for
+};
+
+struct cond {
+  volatile uint seq;    // bumped by every signal and broadcast
+};
+
+struct sem {
+  volatile uint count;
+  volatile uint nwait;  // threads in sem_wait that found count 0
+};
+
 // system calls
 int fork(void);
 int exit(void) __attribute__((noreturn));
@@ -28,7 +42,9 @@ int uptime(void);
 // MOD.11 - THESE ARE ALSO DEFINED IN usys.S
 int clone(void(void*), void*, void*);
 // MOD.12
-int join(int);
+int join(int, void**);
+int futex_wait(volatile uint*, uint);
+int futex_wake(volatile uint*, int);
 
 // user library functions (ulib.c)
 int stat(char*, struct stat*);
@@ -46,7 +62,20 @@ int atoi(const char*);
 // MOD.13
 int thread_create(void(*start_routine)(void*), void*);
 // MOD.14
-int thread_join();
+int thread_join(int);
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+void sem_init(struct sem*, uint);
+void sem_wait(struct sem*);
+void sem_post(struct sem*);
+void* tls(void);
+uint tlsget(int);
+void tlsset(int, uint);
 
 #endif // _USER_H_
 
@@ -323,6 +323,169 @@ exitwait(void)
   printf(1, "exitwait ok\n");
 }
 
+// futexes, and the locks built on them, when nobody has to wait
+void
+futextest(void)
+{
+  static uint word;
+  static struct mutex m;
+  static struct sem s;
+  static struct cond c;
+
+  printf(1, "futex test\n");
+  word = 1;
+  if(futex_wait(&word, 0) != -1){
+    printf(1, "futex_wait slept on a changed word\n");
+    exit();
+  }
+  if(futex_wake(&word, 1) != 0){
+    printf(1, "futex_wake woke someone\n");
+    exit();
+  }
+  if(futex_wait((uint*)((char*)&word + 1), 0) != -1){
+    printf(1, "futex_wait took an unaligned word\n");
+    exit();
+  }
+
+  mutex_init(&m);
+  mutex_lock(&m);
+  if(m.state != 1){
+    printf(1, "mutex not held\n");
+    exit();
+  }
+  mutex_unlock(&m);
+  if(m.state != 0){
+    printf(1, "mutex not released\n");
+    exit();
+  }
+
+  sem_init(&s, 0);
+  sem_post(&s);
+  sem_post(&s);
+  sem_wait(&s);
+  sem_wait(&s);
+  if(s.count != 0){
+    printf(1, "sem count %d\n", s.count);
+    exit();
+  }
+
+  cond_init(&c);
+  cond_signal(&c);
+  cond_broadcast(&c);
+  printf(1, "futex ok\n");
+}
+
+static struct mutex countlock;
+static int count;
+
+void
+countthread(void *arg)
+{
+  int i;
+
+  for(i = 0; i < (int)arg; i++){
+    mutex_lock(&countlock);
+    count++;
+    mutex_unlock(&countlock);
+  }
+  exit();
+}
+
+// threads contend for a mutex, and joining them recycles their
+// stacks instead of growing the heap
+void
+threadtest(void)
+{
+  int i, round, pid[2];
+  char *brk;
+
+  printf(1, "thread test\n");
+  mutex_init(&countlock);
+  brk = 0;
+  for(round = 0; round < 10; round++){
+    count = 0;
+    for(i = 0; i < 2; i++){
+      if((pid[i] = thread_create(countthread, (void*)1000)) < 0){
+        printf(1, "thread_create failed\n");
+        exit();
+      }
+    }
+    if(thread_join(pid[1]) != pid[1] || thread_join(-1) != pid[0]){
+      printf(1, "thread_join failed\n");
+      exit();
+    }
+    if(count != 2000){
+      printf(1, "count %d, not 2000\n", count);
+      exit();
+    }
+    if(round == 0)
+      brk = sbrk(0);
+    else if(sbrk(0) != brk){
+      printf(1, "thread stacks not reused\n");
+      exit();
+    }
+  }
+  if(thread_join(-1) != -1){
+    printf(1, "joined a thread that was not there\n");
+    exit();
+  }
+  printf(1, "thread ok\n");
+}
+
+static struct sem tlsready, tlsgo;
+static int tlsbad;
+
+void
+tlsthread(void *arg)
+{
+  int *self;
+
+  if(tlsget(1) != 0)
+    tlsbad = 1;
+  tlsset(1, (uint)arg);
+  self = tls();
+  sem_post(&tlsready);
+  sem_wait(&tlsgo);
+  // The other threads have set their own word 1 meanwhile.
+  if(tlsget(1) != (uint)arg || self[1] != (int)arg)
+    tlsbad = 1;
+  exit();
+}
+
+// each thread has its own TLS block
+void
+tlstest(void)
+{
+  int i;
+
+  printf(1, "tls test\n");
+  if(tls() == 0){
+    printf(1, "no tls block\n");
+    exit();
+  }
+  tlsset(1, 42);
+  sem_init(&tlsready, 0);
+  sem_init(&tlsgo, 0);
+  tlsbad = 0;
+  for(i = 1; i <= 3; i++){
+    if(thread_create(tlsthread, (void*)(100+i)) < 0){
+      printf(1, "thread_create failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < 3; i++)
+    sem_wait(&tlsready);
+  for(i = 0; i < 3; i++)
+    sem_post(&tlsgo);
+  for(i = 0; i < 3; i++)
+    thread_join(-1);
+  if(tlsbad || tlsget(1) != 42){
+    printf(1, "tls shared between threads\n");
+    exit();
+  }
+  printf(1, "tls ok\n");
+}
+
 void
 mem(void)
 {
@@ -1504,6 +1667,9 @@ main(int argc, char *argv[])
   pipe1();
   preempt();
   exitwait();
+  futextest();
+  threadtest();
+  tlstest();
 
   rmdot();
   fourteen();
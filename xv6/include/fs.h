@@ -6,21 +6,47 @@
 
 // Block 0 is unused.
 // Block 1 is super block.
-// Inodes start at block 2.
+// Inodes start at block 2, followed by the free block bitmap,
+// then the log (sb.nlog blocks at sb.logstart), then data blocks.
 
 #define ROOTINO 1  // root i-number
-#define BSIZE 512  // block size
+#define SECTSIZE 512  // disk sector size
+
+// Block size: 512, 1024 or 2048 (larger would overflow MAXFILE*BSIZE
+// in a uint).  The kernel is built for one block size (FSBSIZE in
+// the Makefile); mkfs takes it as an option and records it in the
+// super block.
+#ifndef FSBSIZE
+#define FSBSIZE 1024
+#endif
+#ifndef BSIZE
+#define BSIZE FSBSIZE
+#endif
 
 // File system super block
 struct superblock {
   uint size;         // Size of file system image (blocks)
   uint nblocks;      // Number of data blocks
   uint ninodes;      // Number of inodes.
+  uint bsize;        // Block size (bytes)
+  uint nlog;         // Number of log blocks, header included
+  uint logstart;     // Block number of the log header
 };
 
-#define NDIRECT 12
+// A file's first blocks are described by up to NEXTENT extents,
+// each a run of len consecutive disk blocks starting at start.
+// File blocks past the extents are found through a double-indirect
+// block: a block of NINDIRECT indirect block addresses, each holding
+// NINDIRECT data block addresses.
+#define NEXTENT 6
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NEXTENT + NDINDIRECT)  // worst case: one-block extents
+
+struct extent {
+  uint start;           // First disk block
+  uint len;             // Number of blocks; 0 if unused
+};
 
 // On-disk inode structure
 struct dinode {
@@ -29,7 +55,8 @@ struct dinode {
   short minor;          // Minor device number (T_DEV only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  struct extent extents[NEXTENT];  // Data block runs
+  uint dindirect;       // Double-indirect block for the rest
 };
 
 // Inodes per block.
@@ -42,7 +69,7 @@ struct dinode {
 #define BPB           (BSIZE*8)
 
 // Block containing bit for block b
-#define BBLOCK(b, ninodes) (b/BPB + (ninodes)/IPB + 3)
+#define BBLOCK(b, ninodes) ((b)/BPB + (ninodes)/IPB + 3)
 
 // Directory is a file containing a sequence of dirent structures.
 #define DIRSIZ 14
@@ -52,4 +79,30 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// A directory that outgrows its first block is turned into a hashed
+// directory (extendible hashing).  Block 0 then holds a header and a
+// table of 1<<depth bucket entries; blocks 1.. are buckets, each an
+// ordinary block of dirents.  Header and table live in dirent slots
+// whose inum is 0, so programs that read the directory see nothing
+// there but free entries.  Directories that are already several
+// blocks long stay linear.
+#define DIRHASHMAGIC "hdir"
+
+struct dirhash {
+  ushort inum;          // Always 0
+  char magic[6];        // DIRHASHMAGIC
+  ushort depth;         // Global depth
+  ushort pad[3];
+};
+
+// Each table slot after the header carries 7 entries: the bucket's
+// block number in the directory (low 12 bits) and the bucket's
+// local depth (high 4 bits).
+#define DHPERSLOT 7
+#define DHSLOT(i) ((1 + (i) / DHPERSLOT) * 8 + 1 + (i) % DHPERSLOT)  // ushort index in block 0
+#define DHMAXENT (DHPERSLOT * (BSIZE / sizeof(struct dirent) - 1))
+#define DHBLOCK(e) ((e) & 0xFFF)
+#define DHDEPTH(e) ((e) >> 12)
+#define DHENT(blk, depth) ((blk) | ((depth) << 12))
+
 #endif // _FS_H_
@@ -0,0 +1,14 @@
+#ifndef _MMAN_H_
+#define _MMAN_H_
+
+// Protection and flags for mmap
+
+#define PROT_READ    0x1
+#define PROT_WRITE   0x2
+
+#define MAP_SHARED   0x1  // write changes back to the file
+#define MAP_PRIVATE  0x2  // changes stay in this process
+
+#define MAP_FAILED   ((void*)-1)
+
+#endif //_MMAN_H_
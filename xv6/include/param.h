@@ -7,11 +7,19 @@
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
+#define NVMA          8  // mmap regions per process
 #define NFILE       100  // open files per system
-#define NBUF         10  // size of disk block cache
-#define NINODE       50  // maximum number of active i-nodes
+#define PIPEPAGES     2  // pages of buffer per pipe (a power of two)
+#define MAXOPBLOCKS  16  // max # of blocks any FS op writes
+#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
+#define NBUF         (LOGSIZE+16)  // size of disk block cache
+#define NINODE       50  // initial inode cache slots (grows on demand)
+#define NDCACHE     128  // directory name cache entries
 #define NDEV         10  // maximum major device number
+#define VIRTIODEV     2  // device number of the virtio disk
+#ifndef ROOTDEV
 #define ROOTDEV       1  // device number of file system root disk
+#endif
 #define USERTOP  0xA0000 // end of user address space
 #define PHYSTOP  0x1000000 // use phys mem up to here as free pool
 #define MAXARG       32  // max exec arguments
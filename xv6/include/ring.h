@@ -0,0 +1,44 @@
+#ifndef _RING_H_
+#define _RING_H_
+
+// A submission/completion ring for batching system calls.
+// The process fills sq[sqtail % NRING] and bumps sqtail, then
+// calls ringenter(ring).  The kernel runs each queued request
+// in order, advancing sqhead, and posts its result at
+// cq[cqtail % NRING], advancing cqtail.  The process consumes
+// completions by advancing cqhead.  The kernel stops early
+// rather than overrun completions the process has not consumed.
+
+#define NRING  32  // entries in each ring (a power of two)
+
+// Operations
+#define RING_NOP    0
+#define RING_READ   1
+#define RING_WRITE  2
+#define RING_OPEN   3
+#define RING_CLOSE  4
+
+struct sqe {
+  int op;
+  int fd;
+  void *buf;      // data, or the path for RING_OPEN
+  int n;          // byte count, or the mode for RING_OPEN
+  int off;        // file offset, or -1 to use the file's own
+  uint data;      // passed through to the completion
+};
+
+struct cqe {
+  uint data;      // from the request
+  int res;        // what the system call would have returned
+};
+
+struct ring {
+  uint sqhead;    // advanced by the kernel
+  uint sqtail;    // advanced by the process
+  uint cqhead;    // advanced by the process
+  uint cqtail;    // advanced by the kernel
+  struct sqe sq[NRING];
+  struct cqe cq[NRING];
+};
+
+#endif // _RING_H_
@@ -26,5 +26,16 @@
 #define SYS_getprocs	22
 #define SYS_settickets	23
 #define SYS_getpinfo	24
+#define SYS_splice	25
+#define SYS_readv	26
+#define SYS_writev	27
+#define SYS_pread	28
+#define SYS_pwrite	29
+#define SYS_mmap	30
+#define SYS_munmap	31
+#define SYS_msync	32
+#define SYS_ringenter	33
+#define SYS_nanosleep	34
+#define SYS_clock_gettime	35
 
 #endif // _SYSCALL_H_
@@ -0,0 +1,10 @@
+#ifndef _TIME_H_
+#define _TIME_H_
+
+// A time, or a length of time, for nanosleep and clock_gettime
+struct timespec {
+  uint sec;
+  uint nsec;   // 0 to 999999999
+};
+
+#endif // _TIME_H_
@@ -37,6 +37,7 @@
 #define IRQ_COM1         4
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_WAKE        20   // IPI to an idle CPU: work to do
 #define IRQ_SPURIOUS    31
 
 #endif // _TRAPS_H_
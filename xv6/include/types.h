@@ -6,6 +6,7 @@
 typedef unsigned int   uint;
 typedef unsigned short ushort;
 typedef unsigned char  uchar;
+typedef unsigned long long uint64;
 typedef uint pde_t;
 #ifndef NULL
 #define NULL (0)
@@ -0,0 +1,12 @@
+#ifndef _UIO_H_
+#define _UIO_H_
+
+// One buffer of a vectored read or write (readv, writev)
+struct iovec {
+  void *base;
+  int len;
+};
+
+#define IOV_MAX  16  // most iovecs per call
+
+#endif // _UIO_H_
@@ -0,0 +1,23 @@
+#ifndef _VDATA_H_
+#define _VDATA_H_
+
+// A page the kernel maps read-only into every process at VDATA,
+// just above user memory, so that reading the tick count or
+// one's own pid needs no system call (see ulib.c).
+
+#define VDATA    USERTOP
+#define VCPUSEL  ((7<<3) | 3)  // user selector of SEG_UCPU, whose
+                               // limit is the CPU's number
+
+struct vcpu {
+  volatile uint nswitch;  // processes switched to on this CPU
+  volatile int pid;       // process running here; 0 if none
+};
+
+struct vdata {
+  volatile uint ticks;    // what sys_uptime would return
+  uint ncpu;
+  struct vcpu cpu[NCPU];  // indexed by CPU number
+};
+
+#endif // _VDATA_H_
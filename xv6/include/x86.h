@@ -11,6 +11,24 @@ inb(ushort port)
   return data;
 }
 
+static inline ushort
+inw(ushort port)
+{
+  ushort data;
+
+  asm volatile("in %1,%0" : "=a" (data) : "d" (port));
+  return data;
+}
+
+static inline uint
+inl(ushort port)
+{
+  uint data;
+
+  asm volatile("in %1,%0" : "=a" (data) : "d" (port));
+  return data;
+}
+
 static inline void
 insl(int port, void *addr, int cnt)
 {
@@ -32,6 +50,12 @@ outw(ushort port, ushort data)
   asm volatile("out %0,%1" : : "a" (data), "d" (port));
 }
 
+static inline void
+outl(ushort port, uint data)
+{
+  asm volatile("out %0,%1" : : "a" (data), "d" (port));
+}
+
 static inline void
 outsl(int port, const void *addr, int cnt)
 {
@@ -126,6 +150,16 @@ sti(void)
   asm volatile("sti");
 }
 
+// Index of the lowest set bit of v, which must not be 0.
+static inline uint
+bsf(uint v)
+{
+  uint r;
+
+  asm("bsfl %1,%0" : "=r" (r) : "rm" (v) : "cc");
+  return r;
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)
 {
@@ -139,6 +173,79 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Atomically add v to *addr and return the old value.
+static inline uint
+fetchadd(volatile uint *addr, uint v)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (v), "+m" (*addr) :
+               :
+               "cc", "memory");
+  return v;
+}
+
+// Spin-wait hint.
+static inline void
+pause(void)
+{
+  asm volatile("pause");
+}
+
+// Low 32 bits of the cycle counter.
+static inline uint
+rdtsc(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return lo;
+}
+
+// The whole cycle counter.
+static inline uint64
+rdtsc64(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64)hi << 32) | lo;
+}
+
+// n / d, for a quotient that fits in 32 bits.  The kernel has
+// no libgcc to do 64-bit division for it.
+static inline uint
+div64(uint64 n, uint d)
+{
+  uint q, r;
+
+  asm("divl %4" : "=a" (q), "=d" (r) : "a" ((uint)n), "d" ((uint)(n >> 32)), "rm" (d));
+  return q;
+}
+
+static inline void
+cpuid(uint op, uint *eax, uint *ebx, uint *ecx, uint *edx)
+{
+  asm volatile("cpuid" :
+               "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) :
+               "a" (op));
+}
+
+// Write model-specific register msr.
+static inline void
+wrmsr(uint msr, uint64 val)
+{
+  asm volatile("wrmsr" : : "c" (msr), "a" ((uint)val), "d" ((uint)(val >> 32)));
+}
+
+// Enable interrupts and wait for one.  The instruction after
+// sti runs before any interrupt is taken, so an interrupt that
+// is already pending ends the hlt instead of being missed.
+static inline void
+stihlt(void)
+{
+  asm volatile("sti; hlt");
+}
+
 static inline void
 lcr0(uint val)
 {
@@ -19,12 +19,14 @@
 // * B_VALID: the buffer data has been initialized
 //     with the associated disk block contents.
 // * B_DIRTY: the buffer data has been modified
-//     and needs to be written to disk.
+//     and needs to be written to disk.  The log keeps
+//     such buffers in the cache until they are committed.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
+#include "fs.h"
 #include "buf.h"
 
 struct {
@@ -55,11 +57,11 @@ binit(void)
   }
 }
 
-// Look through buffer cache for sector on device dev.
+// Look through buffer cache for block on device dev.
 // If not found, allocate fresh block.
 // In either case, return locked buffer.
 static struct buf*
-bget(uint dev, uint sector)
+bget(uint dev, uint blockno)
 {
   struct buf *b;
 
@@ -68,7 +70,7 @@ bget(uint dev, uint sector)
  loop:
   // Try for cached block.
   for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->sector == sector){
+    if(b->dev == dev && b->blockno == blockno){
       if(!(b->flags & B_BUSY)){
         b->flags |= B_BUSY;
         release(&bcache.lock);
@@ -79,11 +81,11 @@ bget(uint dev, uint sector)
     }
   }
 
-  // Allocate fresh block.
+  // Allocate fresh block, never one the log has pinned.
   for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if((b->flags & B_BUSY) == 0){
+    if((b->flags & (B_BUSY|B_DIRTY)) == 0){
       b->dev = dev;
-      b->sector = sector;
+      b->blockno = blockno;
       b->flags = B_BUSY;
       release(&bcache.lock);
       return b;
@@ -92,15 +94,25 @@ bget(uint dev, uint sector)
   panic("bget: no buffers");
 }
 
-// Return a B_BUSY buf with the contents of the indicated disk sector.
+// Pass b to the driver for its device.
+static void
+brw(struct buf *b)
+{
+  if(b->dev == VIRTIODEV)
+    virtiorw(b);
+  else
+    iderw(b);
+}
+
+// Return a B_BUSY buf with the contents of the indicated block.
 struct buf*
-bread(uint dev, uint sector)
+bread(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, sector);
+  b = bget(dev, blockno);
   if(!(b->flags & B_VALID))
-    iderw(b);
+    brw(b);
   return b;
 }
 
@@ -111,7 +123,7 @@ bwrite(struct buf *b)
   if((b->flags & B_BUSY) == 0)
     panic("bwrite");
   b->flags |= B_DIRTY;
-  iderw(b);
+  brw(b);
 }
 
 // Release the buffer b.
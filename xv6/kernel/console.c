@@ -189,6 +189,9 @@ consoleintr(int (*getc)(void))
     case C('P'):  // Process listing.
       procdump();
       break;
+    case C('L'):  // Lock statistics.
+      lockdump();
+      break;
     case C('U'):  // Kill line.
       while(input.e != input.w &&
             input.buf[(input.e-1) % INPUT_BUF] != '\n'){
@@ -231,7 +234,7 @@ consoleread(struct inode *ip, char *dst, int n)
     while(input.r == input.w){
       if(proc->killed){
         release(&input.lock);
-        ilock(ip);
+        ilockshared(ip);
         return -1;
       }
       sleep(&input.r, &input.lock);
@@ -251,7 +254,7 @@ consoleread(struct inode *ip, char *dst, int n)
       break;
   }
   release(&input.lock);
-  ilock(ip);
+  ilockshared(ip);
 
   return target - n;
 }
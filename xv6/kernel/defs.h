@@ -5,10 +5,15 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct pcidev;
 struct pipe;
+struct iovec;
 struct proc;
 struct spinlock;
 struct stat;
+struct timer;
+struct vdata;
+struct hrtimer;
 
 // bio.c
 void            binit(void);
@@ -30,17 +35,24 @@ struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
+int             filepread(struct file*, char*, int n, uint);
+int             filepwrite(struct file*, char*, int n, uint);
 int             fileread(struct file*, char*, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filesplice(struct file*, struct file*, int);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filewritev(struct file*, struct iovec*, int);
 
 // fs.c
+void            dcacheremove(struct inode*, char*);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit(void);
 void            ilock(struct inode*);
+void            ilockshared(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
@@ -49,6 +61,7 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+int             readipipe(struct inode*, struct pipe*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
@@ -70,20 +83,46 @@ void            kinit(void);
 // kbd.c
 void            kbdintr(void);
 
+// mmap.c
+int             mmap(struct file*, int, int, int, int);
+int             mmapcheck(uint, int, int);
+int             mmapfault(uint, int);
+uint            mmapfloor(struct proc*);
+int             mmapfork(struct proc*);
+int             msync(uint, int);
+int             munmap(uint, int);
+void            munmapall(struct proc*);
+
 // lapic.c
 int             cpunum(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(int);
 void            lapicstartap(uchar, uint);
+void            lapiccalibrate(void);
+void            lapictimer(uint64);
+void            lapicipi(int, int);
 void            microdelay(int);
 
+// log.c
+void            initlog(int dev);
+void            log_write(struct buf*);
+void            begin_op(void);
+void            end_op(void);
+
 // mp.c
 extern int      ismp;
 int             mpbcpu(void);
 void            mpinit(void);
 void            mpstartthem(void);
 
+// pci.c
+void            pcienable(struct pcidev*);
+int             pcifindclass(uchar, uchar, struct pcidev*);
+int             pcifindid(ushort, ushort, struct pcidev*);
+uint            pciconfread(struct pcidev*, int);
+void            pciconfwrite(struct pcidev*, int, uint);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
@@ -92,7 +131,11 @@ void            picinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
+int             pipereadv(struct pipe*, struct iovec*, int);
 int             pipewrite(struct pipe*, char*, int);
+int             pipewait(struct pipe*);
+int             pipeput(struct pipe*, char*, int);
+int             pipesplice(struct pipe*, struct pipe*, int);
 
 // proc.c
 struct proc*    copyproc(struct proc*);
@@ -122,10 +165,18 @@ void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            lockdump(void);
+void            lockfree(struct spinlock*);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// virtio.c
+void            virtioinit(void);
+void            virtiointr(void);
+extern int      virtioirq;
+void            virtiorw(struct buf*);
+
 // string.c
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
@@ -138,13 +189,27 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argwptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(struct proc*, uint, int*);
+int             fetchptr(struct proc*, uint, int, int, char**);
 int             fetchstr(struct proc*, uint, char**);
 void            syscall(void);
 
 // timer.c
 void            timerinit(void);
+void            pitwait(void);
+void            clockinit(void);
+uint64          nsecs(void);
+
+// timerwheel.c
+void            timeradd(struct timer*);
+void            timerdel(struct timer*);
+void            timerexpire(uint);
+void            hrtimeradd(struct hrtimer*);
+void            hrtimerdel(struct hrtimer*);
+void            tickupdate(void);
+uint64          nextevent(int);
 
 // trap.c
 void            idtinit(void);
@@ -172,6 +237,9 @@ pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
+uint*           walkpgdir(pde_t*, const void*, int);
+int             mappages(pde_t*, void*, uint, uint, int);
+extern struct vdata* vdata;
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
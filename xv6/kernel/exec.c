@@ -17,9 +17,12 @@ exec(char *path, char **argv)
   struct proghdr ph;
   pde_t *pgdir, *oldpgdir;
 
-  if((ip = namei(path)) == 0)
+  begin_op();
+  if((ip = namei(path)) == 0){
+    end_op();
     return -1;
-  ilock(ip);
+  }
+  ilockshared(ip);
   pgdir = 0;
 
   // Check ELF header
@@ -46,6 +49,7 @@ exec(char *path, char **argv)
       goto bad;
   }
   iunlockput(ip);
+  end_op();
   ip = 0;
 
   // Allocate a one-page stack at the next page boundary
@@ -81,6 +85,7 @@ exec(char *path, char **argv)
   safestrcpy(proc->name, last, sizeof(proc->name));
 
   // Commit to the user image.
+  munmapall(proc);
   oldpgdir = proc->pgdir;
   proc->pgdir = pgdir;
   proc->sz = sz;
@@ -94,7 +99,9 @@ exec(char *path, char **argv)
  bad:
   if(pgdir)
     freevm(pgdir);
-  if(ip)
+  if(ip){
     iunlockput(ip);
+    end_op();
+  }
   return -1;
 }
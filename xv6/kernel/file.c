@@ -1,8 +1,10 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "stat.h"
 #include "fs.h"
 #include "file.h"
+#include "uio.h"
 #include "spinlock.h"
 
 struct devsw devsw[NDEV];
@@ -67,8 +69,40 @@ fileclose(struct file *f)
   
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
-  else if(ff.type == FD_INODE)
+  else if(ff.type == FD_INODE){
+    begin_op();
     iput(ff.ip);
+    end_op();
+  }
+}
+
+// Reads and writes through one struct file take turns,
+// so that each sees the offset the previous one left.
+// Different struct files for the same inode do not wait
+// for each other here.  Devices do not use the offset,
+// and a console read may sleep for a long time, so they
+// skip this.  (ip->type was loaded when the file was opened.)
+static void
+offlock(struct file *f)
+{
+  if(f->ip->type == T_DEV)
+    return;
+  acquire(&ftable.lock);
+  while(f->offbusy)
+    sleep(f, &ftable.lock);
+  f->offbusy = 1;
+  release(&ftable.lock);
+}
+
+static void
+offunlock(struct file *f)
+{
+  if(f->ip->type == T_DEV)
+    return;
+  acquire(&ftable.lock);
+  f->offbusy = 0;
+  wakeup(f);
+  release(&ftable.lock);
 }
 
 // Get metadata about file f.
@@ -76,7 +110,7 @@ int
 filestat(struct file *f, struct stat *st)
 {
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, st);
     iunlock(f->ip);
     return 0;
@@ -84,43 +118,206 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
-// Read from file f.  Addr is kernel address.
+// Read into each of iov[0..cnt) in turn from ip at *off,
+// stopping at end of file.  Caller holds ip's lock.
+static int
+readiv(struct inode *ip, struct iovec *iov, int cnt, uint *off)
+{
+  int i, r, tot;
+
+  tot = 0;
+  for(i = 0; i < cnt; i++){
+    if((r = readi(ip, iov[i].base, *off, iov[i].len)) < 0)
+      return tot > 0 ? tot : r;
+    *off += r;
+    tot += r;
+    if(r < iov[i].len)
+      break;
+  }
+  return tot;
+}
+
+// Write each of iov[0..cnt) in turn to ip at *off.
+// Write a few blocks per transaction so as not to exceed the
+// maximum log transaction size: the blocks themselves, their
+// bitmap block, the inode, the double-indirect and an indirect
+// block, with slop for non-aligned writes.  Each new block is
+// written twice (zeroed, then filled), but the log absorbs the
+// second write.  Small iovecs share a transaction.
+static int
+writeiv(struct inode *ip, struct iovec *iov, int cnt, uint *off)
+{
+  int i, r, n1, done, tot, room, max;
+
+  max = ((MAXOPBLOCKS-1-1-2-2) / 2) * BSIZE;
+  tot = 0;
+  r = 0;
+  room = 0;
+  for(i = 0; i < cnt; i++){
+    for(done = 0; done < iov[i].len; done += r){
+      if(room == 0){
+        begin_op();
+        ilock(ip);
+        room = max;
+      }
+      n1 = iov[i].len - done;
+      if(n1 > room)
+        n1 = room;
+      if((r = writei(ip, (char*)iov[i].base + done, *off, n1)) > 0){
+        *off += r;
+        tot += r;
+        room -= r;
+      }
+      if(r != n1)  // error, or reached MAXFILE
+        goto out;
+      if(room == 0){
+        iunlock(ip);
+        end_op();
+      }
+    }
+  }
+out:
+  if(room > 0){
+    iunlock(ip);
+    end_op();
+  }
+  return tot > 0 ? tot : r;
+}
+
+// Read from file f into iov[0..cnt), kernel addresses.
 int
-fileread(struct file *f, char *addr, int n)
+filereadv(struct file *f, struct iovec *iov, int cnt)
 {
   int r;
 
   if(f->readable == 0)
     return -1;
   if(f->type == FD_PIPE)
-    return piperead(f->pipe, addr, n);
+    return pipereadv(f->pipe, iov, cnt);
   if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
-      f->off += r;
+    offlock(f);
+    ilockshared(f->ip);
+    r = readiv(f->ip, iov, cnt, &f->off);
     iunlock(f->ip);
+    offunlock(f);
     return r;
   }
   panic("fileread");
 }
 
-// Write to file f.  Addr is kernel address.
+// Read from file f.  Addr is kernel address.
 int
-filewrite(struct file *f, char *addr, int n)
+fileread(struct file *f, char *addr, int n)
+{
+  struct iovec iov;
+
+  iov.base = addr;
+  iov.len = n;
+  return filereadv(f, &iov, 1);
+}
+
+// Read from file f at offset off, leaving f's offset alone,
+// so readers sharing f need not take turns.
+int
+filepread(struct file *f, char *addr, int n, uint off)
 {
+  struct iovec iov;
   int r;
 
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  iov.base = addr;
+  iov.len = n;
+  ilockshared(f->ip);
+  r = readiv(f->ip, &iov, 1, &off);
+  iunlock(f->ip);
+  return r;
+}
+
+// Move up to n bytes from file in to pipe out without staging
+// them in user memory: from an inode, straight from the buffer
+// cache; from another pipe, ring to ring.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  int r, m, eof;
+
+  if(in->readable == 0 || out->writable == 0 || out->type != FD_PIPE)
+    return -1;
+  if(in->type == FD_PIPE)
+    return pipesplice(in->pipe, out->pipe, n);
+  if(in->type != FD_INODE || in->ip->type == T_DEV)
+    return -1;
+
+  // Never wait for pipe space holding the inode lock or a buf:
+  // the reader may need them.
+  offlock(in);
+  m = 0;
+  for(r = 0; r < n; r += m){
+    if(pipewait(out->pipe) < 0){
+      m = -1;
+      break;
+    }
+    ilockshared(in->ip);
+    if((m = readipipe(in->ip, out->pipe, in->off, n - r)) > 0)
+      in->off += m;
+    eof = in->off >= in->ip->size;
+    iunlock(in->ip);
+    // Another writer may have filled the pipe since pipewait;
+    // only the end of the file may end the splice with 0.
+    if(m < 0 || (m == 0 && eof))
+      break;
+  }
+  offunlock(in);
+  return r > 0 ? r : m;
+}
+
+// Write iov[0..cnt), kernel addresses, to file f.
+int
+filewritev(struct file *f, struct iovec *iov, int cnt)
+{
+  int i, r, tot;
+
   if(f->writable == 0)
     return -1;
-  if(f->type == FD_PIPE)
-    return pipewrite(f->pipe, addr, n);
+  if(f->type == FD_PIPE){
+    tot = 0;
+    for(i = 0; i < cnt; i++){
+      if((r = pipewrite(f->pipe, iov[i].base, iov[i].len)) < 0)
+        return tot > 0 ? tot : r;
+      tot += r;
+    }
+    return tot;
+  }
   if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = writei(f->ip, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
+    offlock(f);
+    r = writeiv(f->ip, iov, cnt, &f->off);
+    offunlock(f);
     return r;
   }
   panic("filewrite");
 }
 
+// Write to file f.  Addr is kernel address.
+int
+filewrite(struct file *f, char *addr, int n)
+{
+  struct iovec iov;
+
+  iov.base = addr;
+  iov.len = n;
+  return filewritev(f, &iov, 1);
+}
+
+// Write to file f at offset off, leaving f's offset alone.
+int
+filepwrite(struct file *f, char *addr, int n, uint off)
+{
+  struct iovec iov;
+
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  iov.base = addr;
+  iov.len = n;
+  return writeiv(f->ip, &iov, 1, &off);
+}
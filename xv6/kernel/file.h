@@ -8,6 +8,7 @@ struct file {
   struct pipe *pipe;
   struct inode *ip;
   uint off;
+  int offbusy;  // a read or write is using off
 };
 
 
@@ -18,13 +19,20 @@ struct inode {
   uint inum;          // Inode number
   int ref;            // Reference count
   int flags;          // I_BUSY, I_VALID
+  int readers;        // holders of the shared lock
+  int wwait;          // processes waiting for the exclusive lock
+  struct inode *next; // hash chain or free list
 
   short type;         // copy of disk inode
   short major;
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  struct extent extents[NEXTENT];
+  uint dindirect;
+
+  uint prealloc;      // first block reserved for appends
+  uint nprealloc;     // number of blocks reserved
 };
 
 #define I_BUSY 0x1
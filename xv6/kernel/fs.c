@@ -17,22 +17,146 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
-#include "buf.h"
+#include "x86.h"
 #include "fs.h"
+#include "buf.h"
 #include "file.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
-
-// Read the super block.
+static void dcachepurge(uint, uint);
+
+#define MAXBMAP  32   // bitmap blocks summarized in fsinfo
+#define MAXINODES 4096  // inodes summarized in fsinfo
+#define NPREALLOC 8   // blocks reserved ahead of an appending file
+#define NRESV    32   // reservations held at once
+
+// In-memory summary of the file system: the super block, which
+// never changes once made, how many free blocks each bitmap
+// block describes, so that balloc skips full bitmap blocks without
+// reading them, and which inodes are free, so that ialloc goes
+// straight to one.  It also holds the blocks reserved for appending
+// files, which are free on disk, so that a crash cannot leak them,
+// and which balloc skips.  Loaded on first use; only one device is
+// summarized at a time, which is all xv6 needs with just the root
+// mounted.
+static struct {
+  struct spinlock lock;
+  int busy;             // being loaded
+  int valid;
+  uint dev;
+  struct superblock sb;
+  uint nbmap;           // bitmap blocks in use
+  uint nfree[MAXBMAP];  // free blocks per bitmap block
+  uint rotor;           // where allocations without a goal start
+  uint ifree[MAXINODES/32];  // bit set: inode is free
+  uint ihint;           // no free inodes in ifree words before this
+  uint resv[NRESV];     // first block of a reservation, 0 if unused
+  uint nresv[NRESV];    // blocks in it
+} fsinfo;
+
+// Make fsinfo describe dev, reading its super block and counting
+// the free blocks in its bitmap if it does not already.
 static void
-readsb(int dev, struct superblock *sb)
+fsload(uint dev)
 {
   struct buf *bp;
-  
+  struct superblock sb;
+  struct dinode *dip;
+  uint i, b, bi, n, nfree[MAXBMAP];
+
+  acquire(&fsinfo.lock);
+  while(fsinfo.busy)
+    sleep(&fsinfo, &fsinfo.lock);
+  if(fsinfo.valid && fsinfo.dev == dev){
+    release(&fsinfo.lock);
+    return;
+  }
+  fsinfo.busy = 1;
+  fsinfo.valid = 0;
+  release(&fsinfo.lock);
+
   bp = bread(dev, 1);
-  memmove(sb, bp->data, sizeof(*sb));
+  memmove(&sb, bp->data, sizeof(sb));
   brelse(bp);
+  if(sb.bsize != BSIZE)
+    panic("readsb: file system block size differs from BSIZE");
+  n = (sb.size + BPB - 1) / BPB;
+  if(n > MAXBMAP)
+    panic("fsload: too many bitmap blocks");
+  if(sb.ninodes > MAXINODES)
+    panic("fsload: too many inodes");
+
+  for(i = 0; i < n; i++){
+    nfree[i] = 0;
+    bp = bread(dev, BBLOCK(i*BPB, sb.ninodes));
+    for(bi = 0; bi < BPB && (b = i*BPB + bi) < sb.size; bi++)
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+        nfree[i]++;
+    brelse(bp);
+  }
+
+  // Nobody else can allocate until fsinfo is valid, so ifree
+  // can be filled in place.  One read per block of IPB inodes.
+  memset(fsinfo.ifree, 0, sizeof(fsinfo.ifree));
+  for(i = 0; i < sb.ninodes; i += IPB){
+    bp = bread(dev, IBLOCK(i));
+    for(b = i; b < i + IPB && b < sb.ninodes; b++){
+      dip = (struct dinode*)bp->data + b%IPB;
+      if(b > 0 && dip->type == 0)
+        fsinfo.ifree[b/32] |= 1 << (b % 32);
+    }
+    brelse(bp);
+  }
+
+  acquire(&fsinfo.lock);
+  fsinfo.dev = dev;
+  fsinfo.sb = sb;
+  fsinfo.nbmap = n;
+  memmove(fsinfo.nfree, nfree, sizeof(nfree));
+  fsinfo.rotor = 0;
+  fsinfo.ihint = 0;
+  memset(fsinfo.resv, 0, sizeof(fsinfo.resv));
+  fsinfo.valid = 1;
+  fsinfo.busy = 0;
+  wakeup(&fsinfo);
+  release(&fsinfo.lock);
+}
+
+// Read the super block.
+static void
+readsb(int dev, struct superblock *sb)
+{
+  fsload(dev);
+  acquire(&fsinfo.lock);
+  *sb = fsinfo.sb;
+  release(&fsinfo.lock);
+}
+
+// Add delta to the free count of the bitmap block covering b.
+static void
+nfreeadd(uint b, int delta)
+{
+  acquire(&fsinfo.lock);
+  fsinfo.nfree[b / BPB] += delta;
+  release(&fsinfo.lock);
+}
+
+// Is block b reserved for some file?  Reservations only change
+// with b's bitmap block held, so the answer stays good while the
+// caller holds it.
+static int
+breserved(uint b)
+{
+  int i, r;
+
+  r = 0;
+  acquire(&fsinfo.lock);
+  for(i = 0; i < NRESV; i++)
+    if(fsinfo.resv[i] != 0 && b - fsinfo.resv[i] < fsinfo.nresv[i])
+      r = 1;
+  release(&fsinfo.lock);
+  return r;
 }
 
 // Zero a block.
@@ -43,39 +167,167 @@ bzero(int dev, int bno)
   
   bp = bread(dev, bno);
   memset(bp->data, 0, BSIZE);
-  bwrite(bp);
+  log_write(bp);
   brelse(bp);
 }
 
 // Blocks. 
 
-// Allocate a disk block.
+// Allocate a free, unreserved block at or after from in from's
+// bitmap block, scanning the bitmap a word at a time.
+// Returns 0 if there is none.
 static uint
-balloc(uint dev)
+bscan(uint dev, struct superblock *sb, uint from)
 {
-  int b, bi, m;
   struct buf *bp;
+  uint *map, w, free, b;
+
+  bp = bread(dev, BBLOCK(from, sb->ninodes));
+  map = (uint*)bp->data;
+  for(w = (from % BPB) / 32; w < BPB / 32; w++){
+    free = ~map[w];
+    if(w == (from % BPB) / 32)
+      free &= ~0U << (from % 32);
+    for(; free != 0; free &= free - 1){
+      b = from - from % BPB + w*32 + bsf(free);
+      if(b >= sb->size || !breserved(b))
+        break;
+    }
+    if(free == 0)
+      continue;
+    if(b >= sb->size)
+      break;
+    map[w] |= 1 << (b % 32);  // Mark block in use on disk.
+    log_write(bp);
+    brelse(bp);
+    nfreeadd(b, -1);
+    bzero(dev, b);
+    return b;
+  }
+  brelse(bp);
+  return 0;
+}
+
+// Allocate a zeroed disk block, preferring goal or else the first free
+// block after it, so that files can grow their extents in place.
+// With no goal, start where the last such allocation left off.
+static uint
+balloc(uint dev, uint goal)
+{
   struct superblock sb;
+  uint i, bi, b, n, skip;
 
-  bp = 0;
   readsb(dev, &sb);
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb.ninodes));
-    for(bi = 0; bi < BPB; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use on disk.
-        bwrite(bp);
-        brelse(bp);
-        return b + bi;
-      }
+  acquire(&fsinfo.lock);
+  if(goal == 0 || goal >= sb.size)
+    goal = fsinfo.rotor;
+  n = fsinfo.nbmap;
+  release(&fsinfo.lock);
+
+  // Try goal's bitmap block from goal on, then the others in
+  // turn, then the start of goal's block.
+  for(i = 0; i <= n; i++){
+    bi = (goal / BPB + i) % n;
+    acquire(&fsinfo.lock);
+    skip = fsinfo.nfree[bi] == 0;
+    release(&fsinfo.lock);
+    if(skip)
+      continue;
+    if((b = bscan(dev, &sb, i == 0 ? goal : bi*BPB)) != 0){
+      acquire(&fsinfo.lock);
+      fsinfo.rotor = b + 1;
+      release(&fsinfo.lock);
+      return b;
     }
-    brelse(bp);
   }
   panic("balloc: out of blocks");
 }
 
-// Free a disk block.
+// Reserve up to n free blocks starting at b, stopping at the
+// first block that is not free or is reserved, or at the end of
+// b's bitmap block.  The reservation is only in memory; the
+// blocks stay free on disk until btake hands them out.
+// Returns how many were reserved.
+static uint
+breserve(uint dev, uint b, uint n)
+{
+  struct buf *bp;
+  struct superblock sb;
+  uint i, bi, s;
+
+  readsb(dev, &sb);
+  bp = bread(dev, BBLOCK(b, sb.ninodes));
+  for(i = 0; i < n && b + i < sb.size; i++){
+    bi = (b + i) % BPB;
+    if(i > 0 && bi == 0)
+      break;
+    if((bp->data[bi/8] & (1 << (bi % 8))) || breserved(b + i))
+      break;
+  }
+  if(i > 0){
+    acquire(&fsinfo.lock);
+    for(s = 0; s < NRESV && fsinfo.resv[s] != 0; s++)
+      ;
+    if(s < NRESV){
+      fsinfo.resv[s] = b;
+      fsinfo.nresv[s] = i;
+    } else
+      i = 0;
+    release(&fsinfo.lock);
+  }
+  brelse(bp);
+  return i;
+}
+
+// Drop block b from the front of its reservation.
+// Caller holds fsinfo.lock.
+static void
+bresvpop(uint b)
+{
+  int i;
+
+  for(i = 0; i < NRESV; i++){
+    if(fsinfo.resv[i] == b){
+      fsinfo.nresv[i]--;
+      fsinfo.resv[i] = fsinfo.nresv[i] > 0 ? b + 1 : 0;
+      return;
+    }
+  }
+  panic("bresvpop");
+}
+
+// Allocate the first block of ip's reservation: mark it in use
+// on disk, in the caller's transaction, and zero it.
+static uint
+btake(struct inode *ip)
+{
+  struct buf *bp;
+  struct superblock sb;
+  uint b, bi, m;
+
+  b = ip->prealloc;
+  readsb(ip->dev, &sb);
+  bp = bread(ip->dev, BBLOCK(b, sb.ninodes));
+  bi = b % BPB;
+  m = 1 << (bi % 8);
+  if(bp->data[bi/8] & m)
+    panic("btake: reserved block in use");
+  bp->data[bi/8] |= m;
+  log_write(bp);
+  acquire(&fsinfo.lock);
+  bresvpop(b);
+  fsinfo.nfree[b / BPB]--;
+  release(&fsinfo.lock);
+  brelse(bp);
+  bzero(ip->dev, b);
+  ip->prealloc++;
+  ip->nprealloc--;
+  return b;
+}
+
+// Free a disk block.  Blocks are zeroed when they are
+// allocated, not here, so that freeing a large file does
+// not put every one of its blocks in the log.
 static void
 bfree(int dev, uint b)
 {
@@ -83,8 +335,6 @@ bfree(int dev, uint b)
   struct superblock sb;
   int bi, m;
 
-  bzero(dev, b);
-
   readsb(dev, &sb);
   bp = bread(dev, BBLOCK(b, sb.ninodes));
   bi = b % BPB;
@@ -92,8 +342,47 @@ bfree(int dev, uint b)
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;  // Mark block free on disk.
-  bwrite(bp);
+  log_write(bp);
   brelse(bp);
+  nfreeadd(b, 1);
+}
+
+// Give back the blocks ip has reserved but not used.
+// They were never marked on disk, so this writes nothing.
+static void
+bunreserve(struct inode *ip)
+{
+  int i;
+
+  if(ip->nprealloc > 0){
+    acquire(&fsinfo.lock);
+    for(i = 0; i < NRESV; i++)
+      if(fsinfo.resv[i] == ip->prealloc)
+        fsinfo.resv[i] = 0;
+    release(&fsinfo.lock);
+    ip->nprealloc = 0;
+  }
+}
+
+// Allocate a data block to append to ip, preferably goal.
+// A file that grows past its first block gets a window of
+// blocks reserved after each allocation; later appends take
+// them in order, so files written at the same time do not
+// interleave on disk.  Unused reservations are given back
+// when the inode leaves memory or is truncated.
+static uint
+bappend(struct inode *ip, uint goal)
+{
+  uint addr;
+
+  if(goal != 0 && goal == ip->prealloc && ip->nprealloc > 0)
+    return btake(ip);
+  bunreserve(ip);
+  addr = balloc(ip->dev, goal);
+  ip->prealloc = addr + 1;
+  if(goal != 0)
+    ip->nprealloc = breserve(ip->dev, ip->prealloc, NPREALLOC);
+  return addr;
 }
 
 // Inodes.
@@ -110,12 +399,26 @@ bfree(int dev, uint b)
 // 
 // ip->ref counts the number of pointer references to this cached
 // inode; references are typically kept in struct file and in proc->cwd.
-// When ip->ref falls to zero, the inode is no longer cached.
+// When ip->ref falls to zero the inode stays cached, so that it
+// can be found again without reading the disk, until iget needs
+// its slot for another inode.
 // It is an error to use an inode without holding a reference to it.
 //
+// Cached inodes hang off NIHASH hash chains, each with its own
+// spin lock protecting the chain and the ref and flags of the
+// inodes on it, so lookups of different inodes do not contend.
+// Each chain is kept in most-recently-used order; when an inode
+// is not cached, iget takes a slot from the free list, or else
+// the least recently used unreferenced inode on the chain, or
+// else a page of new slots from kalloc.
+//
 // Processes are only allowed to read and write inode
 // metadata and contents when holding the inode's lock,
 // represented by the I_BUSY flag in the in-memory copy.
+// Processes that only read may instead share the lock
+// (ilockshared), counted by ip->readers; a process waiting
+// for the exclusive lock holds off new readers so that it
+// is not starved.
 // Because inode locks are held during disk accesses, 
 // they are implemented using a flag rather than with
 // spin locks.  Callers are responsible for locking
@@ -129,19 +432,143 @@ bfree(int dev, uint b)
 // responsibility to lock them before using them.  A non-zero
 // ip->ref keeps these unlocked inodes in the cache.
 
-struct {
+#define NIHASH 31
+
+struct ibucket {
   struct spinlock lock;
+  struct inode *head;
+};
+
+struct {
+  struct spinlock lock;   // protects free
+  struct inode *free;     // slots on no chain
   struct inode inode[NINODE];
+  struct ibucket bucket[NIHASH];
 } icache;
 
+// Directory name cache: maps (directory, name) to the inum the name
+// refers to, or to 0 if the directory is known not to contain it.
+// Entries only change while the directory's inode is locked, the
+// same as the directory itself: dirlookup fills them in (a shared
+// lock is enough, since they only repeat what is on disk), dirlink
+// and dcacheremove keep them current, and iput drops a directory's
+// entries when the directory is freed.  The cache is set-associative
+// with LRU replacement within each set.
+#define DCWAYS 4
+#define DCSETS (NDCACHE / DCWAYS)
+
+struct dentry {
+  uint dev;
+  uint dinum;           // directory inode number, 0 if unused
+  char name[DIRSIZ];
+  uint inum;            // 0 for a negative entry
+  uint used;            // dcache.clock at last use
+};
+
+struct {
+  struct spinlock lock;
+  uint clock;
+  struct dentry ent[NDCACHE];
+} dcache;
+
 void
 iinit(void)
 {
+  int i;
+
   initlock(&icache.lock, "icache");
+  for(i = 0; i < NIHASH; i++)
+    initlock(&icache.bucket[i].lock, "icache bucket");
+  for(i = 0; i < NINODE; i++){
+    icache.inode[i].next = icache.free;
+    icache.free = &icache.inode[i];
+  }
+  initlock(&dcache.lock, "dcache");
+}
+
+static struct ibucket*
+ibucket(uint dev, uint inum)
+{
+  return &icache.bucket[(inum ^ (dev << 8)) % NIHASH];
+}
+
+// Take a slot off the free list; 0 if it is empty.
+static struct inode*
+ifreeget(void)
+{
+  struct inode *ip;
+
+  acquire(&icache.lock);
+  if((ip = icache.free) != 0)
+    icache.free = ip->next;
+  release(&icache.lock);
+  return ip;
+}
+
+static void
+ifreeput(struct inode *ip)
+{
+  acquire(&icache.lock);
+  ip->next = icache.free;
+  icache.free = ip;
+  release(&icache.lock);
+}
+
+// Add a page of slots to the cache.  Returns one of them
+// and puts the rest on the free list, or 0 if out of memory.
+static struct inode*
+igrow(void)
+{
+  struct inode *ip;
+  char *mem;
+
+  if((mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  for(ip = (struct inode*)mem + 1;
+      ip + 1 <= (struct inode*)(mem + PGSIZE);
+      ip++)
+    ifreeput(ip);
+  return (struct inode*)mem;
 }
 
 static struct inode* iget(uint dev, uint inum);
 
+// Take the lowest free inode number out of the summary,
+// or return 0 if there is none.
+static uint
+inext(uint dev)
+{
+  uint w, inum;
+
+  fsload(dev);
+  inum = 0;
+  acquire(&fsinfo.lock);
+  for(w = fsinfo.ihint; w < (fsinfo.sb.ninodes + 31) / 32; w++){
+    if(fsinfo.ifree[w]){
+      inum = w*32 + bsf(fsinfo.ifree[w]);
+      fsinfo.ifree[w] &= ~(1 << (inum % 32));
+      break;
+    }
+  }
+  fsinfo.ihint = w;
+  release(&fsinfo.lock);
+  return inum;
+}
+
+// Return inum to the summary's free inodes.
+static void
+ifreed(uint dev, uint inum)
+{
+  acquire(&fsinfo.lock);
+  if(fsinfo.valid && fsinfo.dev == dev){
+    fsinfo.ifree[inum/32] |= 1 << (inum % 32);
+    if(inum/32 < fsinfo.ihint)
+      fsinfo.ihint = inum/32;
+  }
+  release(&fsinfo.lock);
+}
+
 // Allocate a new inode with the given type on device dev.
 struct inode*
 ialloc(uint dev, short type)
@@ -149,20 +576,18 @@ ialloc(uint dev, short type)
   int inum;
   struct buf *bp;
   struct dinode *dip;
-  struct superblock sb;
 
-  readsb(dev, &sb);
-  for(inum = 1; inum < sb.ninodes; inum++){  // loop over inode blocks
+  while((inum = inext(dev)) != 0){
     bp = bread(dev, IBLOCK(inum));
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
-      bwrite(bp);   // mark it allocated on the disk
+      log_write(bp);   // mark it allocated on the disk
       brelse(bp);
       return iget(dev, inum);
     }
-    brelse(bp);
+    brelse(bp);  // summary was wrong; leave it out
   }
   panic("ialloc: no inodes");
 }
@@ -181,8 +606,9 @@ iupdate(struct inode *ip)
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
   dip->size = ip->size;
-  memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
-  bwrite(bp);
+  memmove(dip->extents, ip->extents, sizeof(ip->extents));
+  dip->dindirect = ip->dindirect;
+  log_write(bp);
   brelse(bp);
 }
 
@@ -191,32 +617,54 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct ibucket *b;
+  struct inode *ip, *prev, *victim, *vprev;
 
-  acquire(&icache.lock);
+  b = ibucket(dev, inum);
+  acquire(&b->lock);
 
-  // Try for cached inode.
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+  // Try for cached inode, remembering the least recently
+  // used unreferenced one in case it is not there.
+  victim = vprev = 0;
+  for(prev = 0, ip = b->head; ip != 0; prev = ip, ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
       ip->ref++;
-      release(&icache.lock);
+      if(prev != 0){  // move to front
+        prev->next = ip->next;
+        ip->next = b->head;
+        b->head = ip;
+      }
+      release(&b->lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+    if(ip->ref == 0){
+      victim = ip;
+      vprev = prev;
+    }
   }
 
   // Allocate fresh inode.
-  if(empty == 0)
-    panic("iget: no inodes");
+  if((ip = ifreeget()) == 0){
+    if((ip = victim) != 0){
+      if(vprev != 0)
+        vprev->next = ip->next;
+      else
+        b->head = ip->next;
+    } else if((ip = igrow()) == 0)
+      panic("iget: no inodes");
+  }
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->flags = 0;
-  release(&icache.lock);
+  ip->readers = 0;
+  ip->wwait = 0;
+  ip->prealloc = 0;
+  ip->nprealloc = 0;
+  ip->next = b->head;
+  b->head = ip;
+  release(&b->lock);
 
   return ip;
 }
@@ -226,9 +674,12 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
+  struct ibucket *b;
+
+  b = ibucket(ip->dev, ip->inum);
+  acquire(&b->lock);
   ip->ref++;
-  release(&icache.lock);
+  release(&b->lock);
   return ip;
 }
 
@@ -238,15 +689,20 @@ ilock(struct inode *ip)
 {
   struct buf *bp;
   struct dinode *dip;
+  struct ibucket *b;
 
   if(ip == 0 || ip->ref < 1)
     panic("ilock");
 
-  acquire(&icache.lock);
-  while(ip->flags & I_BUSY)
-    sleep(ip, &icache.lock);
+  b = ibucket(ip->dev, ip->inum);
+  acquire(&b->lock);
+  while((ip->flags & I_BUSY) || ip->readers > 0){
+    ip->wwait++;
+    sleep(ip, &b->lock);
+    ip->wwait--;
+  }
   ip->flags |= I_BUSY;
-  release(&icache.lock);
+  release(&b->lock);
 
   if(!(ip->flags & I_VALID)){
     bp = bread(ip->dev, IBLOCK(ip->inum));
@@ -256,7 +712,8 @@ ilock(struct inode *ip)
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
-    memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    memmove(ip->extents, dip->extents, sizeof(ip->extents));
+    ip->dindirect = dip->dindirect;
     brelse(bp);
     ip->flags |= I_VALID;
     if(ip->type == 0)
@@ -264,39 +721,100 @@ ilock(struct inode *ip)
   }
 }
 
-// Unlock the given inode.
+// Lock the given inode for reading only.
+void
+ilockshared(struct inode *ip)
+{
+  struct ibucket *b;
+
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  b = ibucket(ip->dev, ip->inum);
+  acquire(&b->lock);
+  if(!(ip->flags & I_VALID)){
+    // Load it from disk under the exclusive lock, then downgrade.
+    release(&b->lock);
+    ilock(ip);
+    acquire(&b->lock);
+    ip->flags &= ~I_BUSY;
+    ip->readers++;
+    wakeup(ip);
+    release(&b->lock);
+    return;
+  }
+  while((ip->flags & I_BUSY) || ip->wwait > 0)
+    sleep(ip, &b->lock);
+  ip->readers++;
+  release(&b->lock);
+}
+
+// Unlock the given inode, locked by either ilock or ilockshared.
 void
 iunlock(struct inode *ip)
 {
-  if(ip == 0 || !(ip->flags & I_BUSY) || ip->ref < 1)
+  struct ibucket *b;
+
+  if(ip == 0 || ip->ref < 1 || (!(ip->flags & I_BUSY) && ip->readers < 1))
     panic("iunlock");
 
-  acquire(&icache.lock);
-  ip->flags &= ~I_BUSY;
-  wakeup(ip);
-  release(&icache.lock);
+  b = ibucket(ip->dev, ip->inum);
+  acquire(&b->lock);
+  if(ip->flags & I_BUSY)
+    ip->flags &= ~I_BUSY;
+  else
+    ip->readers--;
+  if(ip->readers == 0)
+    wakeup(ip);
+  release(&b->lock);
 }
 
 // Caller holds reference to unlocked ip.  Drop reference.
 void
 iput(struct inode *ip)
 {
-  acquire(&icache.lock);
+  struct ibucket *b;
+  struct inode **pp;
+
+  b = ibucket(ip->dev, ip->inum);
+  acquire(&b->lock);
   if(ip->ref == 1 && (ip->flags & I_VALID) && ip->nlink == 0){
     // inode is no longer used: truncate and free inode.
     if(ip->flags & I_BUSY)
       panic("iput busy");
     ip->flags |= I_BUSY;
-    release(&icache.lock);
+    release(&b->lock);
     itrunc(ip);
+    if(ip->type == T_DIR)
+      dcachepurge(ip->dev, ip->inum);
     ip->type = 0;
     iupdate(ip);
-    acquire(&icache.lock);
+    ifreed(ip->dev, ip->inum);
+    acquire(&b->lock);
     ip->flags = 0;
     wakeup(ip);
+  } else if(ip->ref == 1 && ip->nprealloc > 0){
+    // last reference: give back reserved blocks.
+    if(ip->flags & I_BUSY)
+      panic("iput busy");
+    ip->flags |= I_BUSY;
+    release(&b->lock);
+    bunreserve(ip);
+    acquire(&b->lock);
+    ip->flags &= ~I_BUSY;
+    wakeup(ip);
   }
   ip->ref--;
-  release(&icache.lock);
+  if(ip->ref == 0 && !(ip->flags & I_VALID)){
+    // Nothing worth keeping: put the slot on the free list.
+    for(pp = &b->head; *pp != ip; pp = &(*pp)->next)
+      ;
+    *pp = ip->next;
+    release(&b->lock);
+    ifreeput(ip);
+    return;
+  }
+  release(&b->lock);
 }
 
 // Common idiom: unlock, then put.
@@ -310,40 +828,81 @@ iunlockput(struct inode *ip)
 // Inode contents
 //
 // The contents (data) associated with each inode is stored
-// in a sequence of blocks on the disk.  The first NDIRECT blocks
-// are listed in ip->addrs[].  The next NINDIRECT blocks are 
-// listed in the block ip->addrs[NDIRECT].
-
-// Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// in a sequence of blocks on the disk.  The first blocks are
+// described by the runs in ip->extents[], so a long contiguous
+// file is mapped without reading any block.  Once the extents are
+// used up, the remaining blocks are listed through the
+// double-indirect block ip->dindirect, and the extents stop growing.
+// Files have no holes: a block is only ever allocated just past
+// the end of the ones already mapped.
+
+// Return the disk block for block bn of the double-indirect part
+// of ip (bn counts from the end of the extents).  If there is no
+// such block, install addr, or a newly allocated block if addr is 0.
 static uint
-bmap(struct inode *ip, uint bn)
+dimap(struct inode *ip, uint bn, uint addr)
 {
-  uint addr, *a;
+  uint iaddr, *a;
   struct buf *bp;
 
-  if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
-    return addr;
+  if(bn >= NDINDIRECT)
+    panic("bmap: out of range");
+
+  // Load double-indirect and then indirect block, allocating if necessary.
+  if((iaddr = ip->dindirect) == 0)
+    ip->dindirect = iaddr = balloc(ip->dev, 0);
+  bp = bread(ip->dev, iaddr);
+  a = (uint*)bp->data;
+  if((iaddr = a[bn / NINDIRECT]) == 0){
+    a[bn / NINDIRECT] = iaddr = balloc(ip->dev, 0);
+    log_write(bp);
   }
-  bn -= NDIRECT;
+  brelse(bp);
 
-  if(bn < NINDIRECT){
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
-      bwrite(bp);
-    }
-    brelse(bp);
-    return addr;
+  bp = bread(ip->dev, iaddr);
+  a = (uint*)bp->data;
+  if(a[bn % NINDIRECT] == 0){
+    if(addr == 0)
+      addr = bappend(ip, ip->prealloc);
+    a[bn % NINDIRECT] = addr;
+    log_write(bp);
   }
+  addr = a[bn % NINDIRECT];
+  brelse(bp);
+  return addr;
+}
 
-  panic("bmap: out of range");
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block, bmap allocates one.
+static uint
+bmap(struct inode *ip, uint bn)
+{
+  uint addr, goal;
+  struct extent *e, *last;
+
+  last = 0;
+  for(e = ip->extents; e < &ip->extents[NEXTENT] && e->len > 0; e++){
+    if(bn < e->len)
+      return e->start + bn;
+    bn -= e->len;
+    last = e;
+  }
+  if(ip->dindirect != 0 || bn > 0)
+    return dimap(ip, bn, 0);
+
+  // bn is the first block past the extents.  Grow the last
+  // extent if the next disk block is free, else start a new
+  // extent, else spill into the double-indirect tree.
+  goal = last ? last->start + last->len : 0;
+  addr = bappend(ip, goal);
+  if(last && addr == goal)
+    last->len++;
+  else if(e < &ip->extents[NEXTENT]){
+    e->start = addr;
+    e->len = 1;
+  } else
+    return dimap(ip, 0, addr);
+  return addr;
 }
 
 // Truncate inode (discard contents).
@@ -353,26 +912,36 @@ static void
 itrunc(struct inode *ip)
 {
   int i, j;
-  struct buf *bp;
-  uint *a;
-
-  for(i = 0; i < NDIRECT; i++){
-    if(ip->addrs[i]){
-      bfree(ip->dev, ip->addrs[i]);
-      ip->addrs[i] = 0;
-    }
+  struct extent *e;
+  struct buf *bp, *ibp;
+  uint *a, *ia, iaddr;
+
+  bunreserve(ip);
+  for(e = ip->extents; e < &ip->extents[NEXTENT]; e++){
+    for(i = 0; i < e->len; i++)
+      bfree(ip->dev, e->start + i);
+    e->start = 0;
+    e->len = 0;
   }
-  
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
+
+  if(ip->dindirect){
+    bp = bread(ip->dev, ip->dindirect);
     a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
+    for(i = 0; i < NINDIRECT; i++){
+      if((iaddr = a[i]) == 0)
+        continue;
+      ibp = bread(ip->dev, iaddr);
+      ia = (uint*)ibp->data;
+      for(j = 0; j < NINDIRECT; j++){
+        if(ia[j])
+          bfree(ip->dev, ia[j]);
+      }
+      brelse(ibp);
+      bfree(ip->dev, iaddr);
     }
     brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
+    bfree(ip->dev, ip->dindirect);
+    ip->dindirect = 0;
   }
 
   ip->size = 0;
@@ -417,6 +986,36 @@ readi(struct inode *ip, char *dst, uint off, uint n)
   return n;
 }
 
+// Like readi, but copy straight from the buffer cache into
+// pipe p, stopping early if p fills up.  Return the number of
+// bytes copied, or -1 if there is nothing p can take.
+int
+readipipe(struct inode *ip, struct pipe *p, uint off, uint n)
+{
+  uint tot, m;
+  int k;
+  struct buf *bp;
+
+  if(ip->type == T_DEV)
+    return -1;
+  if(off > ip->size || off + n < off)
+    return -1;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  for(tot=0; tot<n; tot+=m, off+=m){
+    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    m = min(n - tot, BSIZE - off%BSIZE);
+    k = pipeput(p, (char*)bp->data + off%BSIZE, m);
+    brelse(bp);
+    if(k < 0)
+      return tot > 0 ? tot : -1;
+    if(k < m)
+      return tot + k;
+  }
+  return n;
+}
+
 // Write data to inode.
 int
 writei(struct inode *ip, char *src, uint off, uint n)
@@ -439,7 +1038,7 @@ writei(struct inode *ip, char *src, uint off, uint n)
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(bp->data + off%BSIZE, src, m);
-    bwrite(bp);
+    log_write(bp);
     brelse(bp);
   }
 
@@ -458,38 +1057,302 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// FNV-1a hash of a directory entry name.
+static uint
+namehash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261U;
+  for(i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+// First entry of the dcache set that (dev, dinum, name) belongs in.
+static struct dentry*
+dcacheset(uint dev, uint dinum, char *name)
+{
+  return &dcache.ent[((namehash(name) ^ dinum ^ dev) % DCSETS) * DCWAYS];
+}
+
+// Look name up in the dcache for directory dp.  On a hit, set *inum
+// (0 if the name is known to be absent) and return 1.
+static int
+dcachelookup(struct inode *dp, char *name, uint *inum)
+{
+  struct dentry *d, *set;
+  int hit;
+
+  hit = 0;
+  acquire(&dcache.lock);
+  set = dcacheset(dp->dev, dp->inum, name);
+  for(d = set; d < set + DCWAYS; d++){
+    if(d->dinum == dp->inum && d->dev == dp->dev &&
+       namecmp(d->name, name) == 0){
+      d->used = ++dcache.clock;
+      *inum = d->inum;
+      hit = 1;
+      break;
+    }
+  }
+  release(&dcache.lock);
+  return hit;
+}
+
+// Record that name in directory dp refers to inum (0 for absent).
+static void
+dcacheenter(struct inode *dp, char *name, uint inum)
+{
+  struct dentry *d, *set, *victim;
+
+  acquire(&dcache.lock);
+  set = dcacheset(dp->dev, dp->inum, name);
+  victim = set;
+  for(d = set; d < set + DCWAYS; d++){
+    if(d->dinum == dp->inum && d->dev == dp->dev &&
+       namecmp(d->name, name) == 0){
+      victim = d;
+      break;
+    }
+    if(d->used < victim->used)
+      victim = d;
+  }
+  victim->dev = dp->dev;
+  victim->dinum = dp->inum;
+  strncpy(victim->name, name, DIRSIZ);
+  victim->inum = inum;
+  victim->used = ++dcache.clock;
+  release(&dcache.lock);
+}
+
+// Name has been removed from directory dp.
+// Caller must have dp locked.
+void
+dcacheremove(struct inode *dp, char *name)
+{
+  dcacheenter(dp, name, 0);
+}
+
+// Drop every entry for directory inum, which is being freed.
+static void
+dcachepurge(uint dev, uint inum)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.ent; d < &dcache.ent[NDCACHE]; d++){
+    if(d->dinum == inum && d->dev == dev){
+      d->dinum = 0;
+      d->used = 0;
+    }
+  }
+  release(&dcache.lock);
+}
+
+// If dp is a hashed directory, return its block 0, which holds
+// the bucket table, locked.  Otherwise return 0.
+static struct buf*
+dirhashed(struct inode *dp)
+{
+  struct buf *bp;
+  struct dirhash *dh;
+
+  if(dp->size < 2*BSIZE)  // header plus at least one bucket
+    return 0;
+  bp = bread(dp->dev, bmap(dp, 0));
+  dh = (struct dirhash*)bp->data;
+  if(dh->inum == 0 && strncmp(dh->magic, DIRHASHMAGIC, sizeof(dh->magic)) == 0)
+    return bp;
+  brelse(bp);
+  return 0;
+}
+
+// Table entry for the bucket that hash h falls in.
+static uint
+dirbucket(struct buf *hbp, uint h)
+{
+  struct dirhash *dh = (struct dirhash*)hbp->data;
+
+  return ((ushort*)hbp->data)[DHSLOT(h & ((1 << dh->depth) - 1))];
+}
+
+// Look for name in block bn of directory dp.
+// If found, set *poff and return the entry's inum, else return 0.
+static uint
+dirscan(struct inode *dp, uint bn, char *name, uint *poff)
+{
+  uint inum;
+  struct buf *bp;
+  struct dirent *de;
+
+  inum = 0;
+  bp = bread(dp->dev, bmap(dp, bn));
+  for(de = (struct dirent*)bp->data;
+      de < (struct dirent*)(bp->data + BSIZE);
+      de++){
+    if(de->inum == 0)
+      continue;
+    if(namecmp(name, de->name) == 0){
+      // entry matches path element
+      if(poff)
+        *poff = bn*BSIZE + (uchar*)de - bp->data;
+      inum = de->inum;
+      break;
+    }
+  }
+  brelse(bp);
+  return inum;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 // Caller must have already locked dp.
+// The dcache does not record offsets, so only lookups that
+// do not want one can be answered by a positive entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
   uint off, inum;
-  struct buf *bp;
-  struct dirent *de;
+  struct buf *hbp;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += BSIZE){
-    bp = bread(dp->dev, bmap(dp, off / BSIZE));
+  if(dcachelookup(dp, name, &inum) && (inum == 0 || poff == 0)){
+    if(inum == 0)
+      return 0;
+    return iget(dp->dev, inum);
+  }
+
+  inum = 0;
+  if((hbp = dirhashed(dp)) != 0){
+    off = DHBLOCK(dirbucket(hbp, namehash(name)));
+    brelse(hbp);
+    inum = dirscan(dp, off, name, poff);
+  } else {
+    for(off = 0; off < dp->size && inum == 0; off += BSIZE)
+      inum = dirscan(dp, off / BSIZE, name, poff);
+  }
+  dcacheenter(dp, name, inum);
+  if(inum == 0)
+    return 0;
+  return iget(dp->dev, inum);
+}
+
+// Turn the one-block linear directory dp into a hashed directory:
+// its entries move to bucket 1 and block 0 becomes the table.
+// Returns block 0, locked.
+static struct buf*
+dirhashinit(struct inode *dp)
+{
+  struct buf *hbp, *bp;
+  struct dirhash *dh;
+
+  hbp = bread(dp->dev, bmap(dp, 0));
+  bp = bread(dp->dev, bmap(dp, 1));
+  memmove(bp->data, hbp->data, BSIZE);
+  log_write(bp);
+  brelse(bp);
+  dp->size = 2*BSIZE;
+  iupdate(dp);
+
+  memset(hbp->data, 0, BSIZE);
+  dh = (struct dirhash*)hbp->data;
+  memmove(dh->magic, DIRHASHMAGIC, sizeof(DIRHASHMAGIC));
+  dh->depth = 0;
+  ((ushort*)hbp->data)[DHSLOT(0)] = DHENT(1, 0);
+  log_write(hbp);
+  return hbp;
+}
+
+// Split the full bucket with table entry e in two, doubling the
+// table first if the bucket is already at the global depth.
+// Returns -1 if the table cannot grow any further.
+static int
+dirsplit(struct inode *dp, struct buf *hbp, uint e)
+{
+  struct dirhash *dh = (struct dirhash*)hbp->data;
+  ushort *tab = (ushort*)hbp->data;
+  struct buf *obp, *nbp;
+  struct dirent *de, *nde;
+  uint d, i, n, nb;
+
+  d = DHDEPTH(e);
+  nb = dp->size / BSIZE;
+  if(nb > DHBLOCK(0xFFFF))
+    return -1;
+  if(d == dh->depth){
+    n = 1 << d;
+    if(2*n > DHMAXENT)
+      return -1;
+    for(i = 0; i < n; i++)
+      tab[DHSLOT(n + i)] = tab[DHSLOT(i)];
+    dh->depth++;
+  }
+
+  // Entries whose hash has bit d set move to a new bucket.
+  obp = bread(dp->dev, bmap(dp, DHBLOCK(e)));
+  nbp = bread(dp->dev, bmap(dp, nb));
+  dp->size += BSIZE;
+  iupdate(dp);
+  nde = (struct dirent*)nbp->data;
+  for(de = (struct dirent*)obp->data;
+      de < (struct dirent*)(obp->data + BSIZE);
+      de++){
+    if(de->inum != 0 && (namehash(de->name) >> d) & 1){
+      *nde++ = *de;
+      memset(de, 0, sizeof(*de));
+    }
+  }
+  log_write(nbp);
+  brelse(nbp);
+  log_write(obp);
+  brelse(obp);
+
+  for(i = 0; i < (1 << dh->depth); i++){
+    if(DHBLOCK(tab[DHSLOT(i)]) == DHBLOCK(e))
+      tab[DHSLOT(i)] = DHENT((i >> d) & 1 ? nb : DHBLOCK(e), d + 1);
+  }
+  log_write(hbp);
+  return 0;
+}
+
+// Add (name, inum) to the hashed directory dp whose table is in hbp,
+// splitting the bucket until it has room.  Releases hbp.
+static int
+dirhashlink(struct inode *dp, struct buf *hbp, char *name, uint inum)
+{
+  uint h, e;
+  struct buf *bp;
+  struct dirent *de;
+
+  h = namehash(name);
+  for(;;){
+    e = dirbucket(hbp, h);
+    bp = bread(dp->dev, bmap(dp, DHBLOCK(e)));
     for(de = (struct dirent*)bp->data;
         de < (struct dirent*)(bp->data + BSIZE);
         de++){
-      if(de->inum == 0)
-        continue;
-      if(namecmp(name, de->name) == 0){
-        // entry matches path element
-        if(poff)
-          *poff = off + (uchar*)de - bp->data;
-        inum = de->inum;
+      if(de->inum == 0){
+        strncpy(de->name, name, DIRSIZ);
+        de->inum = inum;
+        log_write(bp);
         brelse(bp);
-        return iget(dp->dev, inum);
+        brelse(hbp);
+        dcacheenter(dp, name, inum);
+        return 0;
       }
     }
     brelse(bp);
+    if(dirsplit(dp, hbp, e) < 0){
+      brelse(hbp);
+      return -1;
+    }
   }
-  return 0;
 }
 
 // Write a new directory entry (name, inum) into the directory dp.
@@ -499,6 +1362,7 @@ dirlink(struct inode *dp, char *name, uint inum)
   int off;
   struct dirent de;
   struct inode *ip;
+  struct buf *hbp;
 
   // Check that name is not present.
   if((ip = dirlookup(dp, name, 0)) != 0){
@@ -506,6 +1370,9 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
+  if((hbp = dirhashed(dp)) != 0)
+    return dirhashlink(dp, hbp, name, inum);
+
   // Look for an empty dirent.
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
@@ -514,10 +1381,16 @@ dirlink(struct inode *dp, char *name, uint inum)
       break;
   }
 
+  // A full one-block directory becomes hashed rather than growing
+  // linearly.  Longer linear ones, as mkfs writes, stay linear.
+  if(off == BSIZE && dp->size == BSIZE)
+    return dirhashlink(dp, dirhashinit(dp), name, inum);
+
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcacheenter(dp, name, inum);
   
   return 0;
 }
@@ -575,7 +1448,7 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(proc->cwd);
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    ilockshared(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
       return 0;
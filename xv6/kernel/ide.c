@@ -1,4 +1,6 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// Simple IDE driver code.
+// Uses PCI bus-master DMA when the controller supports it
+// and falls back to programmed I/O otherwise.
 
 #include "types.h"
 #include "defs.h"
@@ -8,7 +10,9 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "fs.h"
 #include "buf.h"
+#include "pci.h"
 
 #define IDE_BSY       0x80
 #define IDE_DRDY      0x40
@@ -17,6 +21,31 @@
 
 #define IDE_CMD_READ  0x20
 #define IDE_CMD_WRITE 0x30
+#define IDE_CMD_RDMUL 0xc4
+#define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+#define IDE_CMD_READ_DMA  0xc8
+#define IDE_CMD_WRITE_DMA 0xca
+
+// Bus-master IDE registers for the primary channel,
+// relative to the I/O base in BAR4 of the controller.
+#define BM_CMD        0x0
+  #define BM_CMD_START  0x01   // start/stop the transfer
+  #define BM_CMD_READ   0x08   // disk to memory (vs memory to disk)
+#define BM_STATUS     0x2
+  #define BM_ST_ERR     0x02   // transfer error (write 1 to clear)
+  #define BM_ST_INTR    0x04   // interrupt raised (write 1 to clear)
+#define BM_PRDT       0x4      // physical address of the PRD table
+
+// Physical region descriptor: one contiguous piece of a DMA transfer.
+// A region may not cross a 64K boundary, so a block buffer
+// needs at most two of them.
+struct prd {
+  uint addr;      // physical address
+  ushort count;   // bytes
+  ushort flags;
+};
+#define PRD_EOT 0x8000  // last entry in the table
 
 // idequeue points to the buf now being read/written to the disk.
 // idequeue->qnext points to the next buf to be processed.
@@ -27,6 +56,18 @@ static struct buf *idequeue;
 
 static int havedisk1;
 static void idestart(struct buf*);
+static void idedmainit(void);
+
+// PIO state.  With usemult, READ/WRITE MULTIPLE move a whole
+// block per interrupt; without it, each interrupt moves one
+// sector.  piooff is how far into idequeue's data PIO has got.
+static int usemult;
+static int piooff;
+
+// Bus-master DMA state; usedma is 0 if we must use PIO.
+static int usedma;
+static ushort bmbase;
+static struct prd prdt[2] __attribute__((aligned(16)));
 
 // Wait for IDE disk to become ready.
 static int
@@ -41,6 +82,24 @@ idewait(int checkerr)
   return 0;
 }
 
+// Ask disk dev to move a block's worth of sectors per DRQ with
+// READ/WRITE MULTIPLE.  Return -1 if it refuses.
+static int
+idesetmult(int dev)
+{
+  int i, r;
+
+  outb(0x3f6, 2);  // no interrupt; idestart turns them back on
+  outb(0x1f2, BSIZE/SECTSIZE);
+  outb(0x1f6, 0xe0 | (dev<<4));
+  outb(0x1f7, IDE_CMD_SETMUL);
+  for(i = 0; i < 4; i++)  // give BSY 400ns to come up
+    inb(0x3f6);
+  r = idewait(1);
+  outb(0x1f6, 0xe0 | (0<<4));
+  return r;
+}
+
 void
 ideinit(void)
 {
@@ -62,27 +121,90 @@ ideinit(void)
   
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
+
+  // The multiple count must be set before READ/WRITE MULTIPLE,
+  // and a drive may not support a block's worth.
+  if(BSIZE/SECTSIZE > 1)
+    usemult = idesetmult(0) == 0 && (!havedisk1 || idesetmult(1) == 0);
+
+  idedmainit();
+}
+
+// Look for a PCI IDE controller that can bus master.
+// Without one, usedma stays 0 and every transfer uses PIO.
+static void
+idedmainit(void)
+{
+  struct pcidev d;
+
+  if(pcifindclass(0x01, 0x01, &d) < 0)
+    return;
+  if(!(d.progif & 0x80) || !(d.bar[4] & PCI_BAR_IO))
+    return;
+  pcienable(&d);
+  bmbase = d.bar[4] & ~3;
+  outl(bmbase+BM_PRDT, PADDR(prdt));
+  usedma = 1;
+  cprintf("ide: bus-master dma at 0x%x\n", bmbase);
+}
+
+// Point the PRD table at b->data and arm the DMA engine
+// for the direction of b's transfer.  Caller must hold idelock.
+static void
+idedmastart(struct buf *b)
+{
+  uint pa, n;
+  int i;
+
+  pa = PADDR(b->data);
+  n = sizeof(b->data);
+  for(i = 0; n > 0; i++){
+    prdt[i].addr = pa;
+    prdt[i].count = n;
+    if((pa & 0xFFFF) + n > 0x10000)
+      prdt[i].count = 0x10000 - (pa & 0xFFFF);
+    prdt[i].flags = 0;
+    pa += prdt[i].count;
+    n -= prdt[i].count;
+  }
+  prdt[i-1].flags = PRD_EOT;
+
+  outb(bmbase+BM_CMD, (b->flags & B_DIRTY) ? 0 : BM_CMD_READ);
+  outb(bmbase+BM_STATUS, BM_ST_ERR | BM_ST_INTR);
 }
 
 // Start the request for b.  Caller must hold idelock.
+// A block is BSIZE/SECTSIZE consecutive sectors; PIO moves them
+// with READ/WRITE MULTIPLE if the disks allow, so there is one
+// interrupt per block, and otherwise one sector per interrupt.
 static void
 idestart(struct buf *b)
 {
+  int nsect, sector;
+
   if(b == 0)
     panic("idestart");
+  nsect = BSIZE/SECTSIZE;
+  sector = b->blockno * nsect;
+  piooff = 0;
 
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, 1);  // number of sectors
-  outb(0x1f3, b->sector & 0xff);
-  outb(0x1f4, (b->sector >> 8) & 0xff);
-  outb(0x1f5, (b->sector >> 16) & 0xff);
-  outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((b->sector>>24)&0x0f));
-  if(b->flags & B_DIRTY){
-    outb(0x1f7, IDE_CMD_WRITE);
-    outsl(0x1f0, b->data, 512/4);
+  outb(0x1f2, nsect);  // number of sectors
+  outb(0x1f3, sector & 0xff);
+  outb(0x1f4, (sector >> 8) & 0xff);
+  outb(0x1f5, (sector >> 16) & 0xff);
+  outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
+  if(usedma){
+    idedmastart(b);
+    outb(0x1f7, (b->flags & B_DIRTY) ? IDE_CMD_WRITE_DMA : IDE_CMD_READ_DMA);
+    outb(bmbase+BM_CMD, inb(bmbase+BM_CMD) | BM_CMD_START);
+  } else if(b->flags & B_DIRTY){
+    outb(0x1f7, usemult ? IDE_CMD_WRMUL : IDE_CMD_WRITE);
+    piooff = usemult ? BSIZE : SECTSIZE;
+    outsl(0x1f0, b->data, piooff/4);
   } else {
-    outb(0x1f7, IDE_CMD_READ);
+    outb(0x1f7, usemult ? IDE_CMD_RDMUL : IDE_CMD_READ);
   }
 }
 
@@ -91,6 +213,7 @@ void
 ideintr(void)
 {
   struct buf *b;
+  int n, st;
 
   // Take first buffer off queue.
   acquire(&idelock);
@@ -99,11 +222,41 @@ ideintr(void)
     // cprintf("spurious IDE interrupt\n");
     return;
   }
-  idequeue = b->qnext;
 
-  // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, 512/4);
+  if(usedma){
+    // Stop the engine and acknowledge the controller.
+    st = inb(bmbase+BM_STATUS);
+    outb(bmbase+BM_CMD, inb(bmbase+BM_CMD) & ~BM_CMD_START);
+    outb(bmbase+BM_STATUS, BM_ST_ERR | BM_ST_INTR);
+    if(idewait(1) < 0 || (st & BM_ST_ERR)){
+      // Retry this buf, and all later ones, with PIO.
+      cprintf("ide: dma error, falling back to pio\n");
+      usedma = 0;
+      idestart(b);
+      release(&idelock);
+      return;
+    }
+  }
+
+  // With PIO, move the next sector or block; with DMA the data
+  // is already in place.  Wait for the next interrupt until the
+  // whole buf has moved.
+  if(!usedma && idewait(1) >= 0){
+    n = usemult ? BSIZE : SECTSIZE;
+    if(!(b->flags & B_DIRTY)){
+      insl(0x1f0, b->data + piooff, n/4);
+      piooff += n;
+    }
+    if(piooff < BSIZE){
+      if(b->flags & B_DIRTY){
+        outsl(0x1f0, b->data + piooff, n/4);
+        piooff += n;
+      }
+      release(&idelock);
+      return;
+    }
+  }
+  idequeue = b->qnext;
   
   // Wake process waiting for this buf.
   b->flags |= B_VALID;
@@ -40,6 +40,8 @@
 
 volatile uint *lapic;  // Initialized in mp.c
 
+static uint lapicperus;  // timer counts per microsecond; 0 until calibrated
+
 static void
 lapicw(int index, int value)
 {
@@ -57,13 +59,13 @@ lapicinit(int c)
   // Enable local APIC; set spurious interrupt vector.
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
-  // The timer repeatedly counts down at bus frequency
-  // from lapic[TICR] and then issues an interrupt.  
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // The timer counts down once at bus frequency from
+  // lapic[TICR] and then issues an interrupt; each timer
+  // interrupt arms it again for the next event (lapictimer).
+  // Until lapiccalibrate has run, guess at the count.
   lapicw(TDCR, X1);
-  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000); 
+  lapicw(TIMER, T_IRQ0 + IRQ_TIMER);
+  lapicw(TICR, lapicperus ? lapicperus*10000 : 10000000);
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -122,6 +124,60 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Measure the timer's rate against the PIT.
+// Runs on the boot processor before the others start.
+void
+lapiccalibrate(void)
+{
+  uint n;
+
+  if(!lapic)
+    return;
+  lapicw(TIMER, MASKED | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TICR, 0xFFFFFFFF);
+  pitwait();
+  n = 0xFFFFFFFF - lapic[TCCR];
+  lapicperus = n / 10000;
+  if(lapicperus == 0)
+    lapicperus = 1;
+  cprintf("lapic: timer %d counts/us\n", lapicperus);
+  lapicw(TIMER, T_IRQ0 + IRQ_TIMER);
+  lapicw(TICR, lapicperus*10000);
+}
+
+// Interrupt this CPU at time when, in nsecs().  A deadline more
+// than a second away is cut to a second, which also keeps the
+// count in range.
+void
+lapictimer(uint64 when)
+{
+  uint64 now, d;
+  uint count;
+
+  if(!lapic || lapicperus == 0)
+    return;
+  now = nsecs();
+  d = when > now ? when - now : 0;
+  if(d > 1000000000)
+    d = 1000000000;
+  count = div64(d * lapicperus, 1000);
+  if(count == 0)
+    count = 1;
+  lapicw(TICR, count);
+}
+
+// Send interrupt vector to the CPU with the given APIC ID.
+void
+lapicipi(int apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
@@ -0,0 +1,247 @@
+// Write-ahead log for file system metadata (and data) updates.
+//
+// A system call that changes the file system brackets its work
+// with begin_op() and end_op(), and inside that uses log_write(b)
+// where it used to call bwrite(b).  log_write does not write:
+// it records b's block number in the in-memory log header and
+// pins b in the buffer cache (B_DIRTY) until commit.
+//
+// Operations that run at the same time join one transaction
+// (group commit).  The last one to call end_op commits them all:
+// it copies every modified block to the log area, writes the
+// header (the commit point), writes the blocks to their home
+// locations (the checkpoint), and erases the header.  A block
+// changed by several operations in the group is logged once.
+//
+// After a crash, initlog finds a non-empty header and replays the
+// log, so each group's changes are either all on disk or not at all.
+//
+// The on-disk log is a header block followed by LOGSIZE blocks:
+//   header: n, block numbers of the n logged blocks
+//   then the logged blocks, in header order.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "buf.h"
+
+struct logheader {
+  int n;
+  int block[LOGSIZE];
+};
+
+struct {
+  struct spinlock lock;
+  int start;        // first block of the log (the header)
+  int size;         // header plus LOGSIZE
+  int outstanding;  // operations in the current transaction
+  int committing;   // commit() is running; wait for it
+  int dev;
+  struct logheader lh;
+} log;
+
+static void recover_from_log(void);
+static void commit(void);
+
+// Read the log's location from the super block and replay
+// anything a crash left behind.  Needs a process context.
+void
+initlog(int dev)
+{
+  struct buf *bp;
+  struct superblock sb;
+
+  if(sizeof(struct logheader) > BSIZE)
+    panic("initlog: too big logheader");
+
+  initlock(&log.lock, "log");
+  bp = bread(dev, 1);
+  memmove(&sb, bp->data, sizeof(sb));
+  brelse(bp);
+  if(sb.nlog < LOGSIZE + 1)
+    panic("initlog: log too small");
+  log.start = sb.logstart;
+  log.size = sb.nlog;
+  log.dev = dev;
+  recover_from_log();
+}
+
+// Write committed blocks to their home locations.  After a
+// commit the cache still holds them, pinned; during recovery
+// they must be copied from the log.
+static void
+install_trans(int recovering)
+{
+  int tail;
+  struct buf *lbuf, *dbuf;
+
+  for(tail = 0; tail < log.lh.n; tail++){
+    dbuf = bread(log.dev, log.lh.block[tail]);
+    if(recovering){
+      lbuf = bread(log.dev, log.start+tail+1);
+      memmove(dbuf->data, lbuf->data, BSIZE);
+      brelse(lbuf);
+    }
+    bwrite(dbuf);
+    brelse(dbuf);
+  }
+}
+
+// Read the log header from disk into the in-memory log header.
+static void
+read_head(void)
+{
+  struct buf *bp;
+  struct logheader *lh;
+  int i;
+
+  bp = bread(log.dev, log.start);
+  lh = (struct logheader*)bp->data;
+  log.lh.n = lh->n;
+  for(i = 0; i < log.lh.n; i++)
+    log.lh.block[i] = lh->block[i];
+  brelse(bp);
+}
+
+// Write the in-memory log header to disk.  With n > 0 this is
+// the point at which the current transaction commits.
+static void
+write_head(void)
+{
+  struct buf *bp;
+  struct logheader *hb;
+  int i;
+
+  bp = bread(log.dev, log.start);
+  hb = (struct logheader*)bp->data;
+  hb->n = log.lh.n;
+  for(i = 0; i < log.lh.n; i++)
+    hb->block[i] = log.lh.block[i];
+  bwrite(bp);
+  brelse(bp);
+}
+
+static void
+recover_from_log(void)
+{
+  read_head();
+  if(log.lh.n > 0)
+    cprintf("log: recovering %d blocks\n", log.lh.n);
+  install_trans(1);
+  log.lh.n = 0;
+  write_head();
+}
+
+// Called at the start of each file system system call.
+void
+begin_op(void)
+{
+  acquire(&log.lock);
+  for(;;){
+    if(log.committing){
+      sleep(&log, &log.lock);
+    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+      // This op might exhaust log space; wait for commit.
+      sleep(&log, &log.lock);
+    } else {
+      log.outstanding++;
+      release(&log.lock);
+      break;
+    }
+  }
+}
+
+// Called at the end of each file system system call.
+// Commits if this was the last outstanding operation.
+void
+end_op(void)
+{
+  int do_commit;
+
+  do_commit = 0;
+  acquire(&log.lock);
+  log.outstanding--;
+  if(log.committing)
+    panic("log.committing");
+  if(log.outstanding == 0){
+    do_commit = 1;
+    log.committing = 1;
+  } else {
+    // begin_op() may be waiting for log space.
+    wakeup(&log);
+  }
+  release(&log.lock);
+
+  if(do_commit){
+    // Call commit without holding locks, since not allowed
+    // to sleep with locks.
+    commit();
+    acquire(&log.lock);
+    log.committing = 0;
+    wakeup(&log);
+    release(&log.lock);
+  }
+}
+
+// Copy modified blocks from the cache to the log.
+static void
+write_log(void)
+{
+  int tail;
+  struct buf *to, *from;
+
+  for(tail = 0; tail < log.lh.n; tail++){
+    to = bread(log.dev, log.start+tail+1);
+    from = bread(log.dev, log.lh.block[tail]);
+    memmove(to->data, from->data, BSIZE);
+    bwrite(to);
+    brelse(from);
+    brelse(to);
+  }
+}
+
+static void
+commit(void)
+{
+  if(log.lh.n > 0){
+    write_log();      // Write modified blocks from cache to log
+    write_head();     // Write header to disk -- the real commit
+    install_trans(0); // Now install writes to home locations
+    log.lh.n = 0;
+    write_head();     // Erase the transaction from the log
+  }
+}
+
+// Caller has modified b->data and is done with the buffer.
+// Record the block number and pin b in the cache with B_DIRTY;
+// commit()/write_log() will do the disk write.
+//
+// log_write() replaces bwrite(); a typical use is:
+//   bp = bread(...)
+//   modify bp->data[]
+//   log_write(bp)
+//   brelse(bp)
+void
+log_write(struct buf *b)
+{
+  int i;
+
+  if(log.outstanding < 1)
+    panic("log_write outside of trans");
+
+  acquire(&log.lock);
+  for(i = 0; i < log.lh.n; i++){
+    if(log.lh.block[i] == b->blockno)   // log absorption
+      break;
+  }
+  if(i == log.lh.n){
+    if(log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+      panic("too big a transaction");
+    log.lh.block[i] = b->blockno;
+    log.lh.n++;
+  }
+  b->flags |= B_DIRTY;  // prevent eviction
+  release(&log.lock);
+}
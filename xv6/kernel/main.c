@@ -54,6 +54,9 @@ mainc(void)
   fileinit();      // file table
   iinit();         // inode cache
   ideinit();       // disk
+  virtioinit();    // virtio disk, if any
+  clockinit();     // nanosecond clock
+  lapiccalibrate(); // one-shot local APIC timer
   if(!ismp)
     timerinit();   // uniprocessor timer
   bootothers();    // start other processors
@@ -11,8 +11,11 @@ KERNEL_OBJECTS := \
 	kalloc.o\
 	kbd.o\
 	lapic.o\
+	log.o\
 	main.o\
+	mmap.o\
 	mp.o\
+	pci.o\
 	picirq.o\
 	pipe.o\
 	proc.o\
@@ -23,10 +26,12 @@ KERNEL_OBJECTS := \
 	sysfile.o\
 	sysproc.o\
 	timer.o\
+	timerwheel.o\
 	trapasm.o\
 	trap.o\
 	uart.o\
 	vectors.o\
+	virtio.o\
 	vm.o\
 
 KERNEL_OBJECTS := $(addprefix kernel/, $(KERNEL_OBJECTS))
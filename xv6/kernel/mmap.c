@@ -0,0 +1,336 @@
+// Memory-mapped files.
+//
+// mmap records a region in the process's vma table and maps
+// nothing.  The first touch of each page faults; mmapfault reads
+// the page from the file through the buffer cache and maps it.
+// Regions are placed top down from USERTOP, and sbrk may not grow
+// the heap into them.
+//
+// A MAP_SHARED region writes its dirty pages back to the file on
+// munmap, msync, exec and exit.  Pages are not shared between
+// processes: each process sees other processes' changes only
+// after they have been written back, and a forked child starts
+// with no shared pages, faulting them in from the file.  A
+// MAP_PRIVATE region is never written back; fork copies the
+// pages the parent has touched.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "stat.h"
+#include "fs.h"
+#include "file.h"
+#include "mman.h"
+
+// Return the region of p containing va, or 0.
+static struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->f && va >= v->start && va < v->start + v->len)
+      return v;
+  return 0;
+}
+
+// Lowest address used by a region, or USERTOP if none;
+// the heap must stay below it.
+uint
+mmapfloor(struct proc *p)
+{
+  struct vma *v;
+  uint floor;
+
+  floor = USERTOP;
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->f && v->start < floor)
+      floor = v->start;
+  return floor;
+}
+
+// Fill in and map the page of the current process containing va.
+// Return -1 if va is not in a region, or write is set and the
+// region is read-only, or there is no memory.
+int
+mmapfault(uint va, int write)
+{
+  struct vma *v;
+  pte_t *pte;
+  char *a, *mem;
+  int perm;
+
+  if((v = findvma(proc, va)) == 0)
+    return -1;
+  if(write && !(v->prot & PROT_WRITE))
+    return -1;
+  a = PGROUNDDOWN(va);
+  if((pte = walkpgdir(proc->pgdir, a, 0)) != 0 && (*pte & PTE_P))
+    return -1;  // present, so a protection fault
+  if((mem = kalloc()) == 0)
+    return -1;
+  // Past the end of the file reads as zeros.
+  memset(mem, 0, PGSIZE);
+  ilockshared(v->f->ip);
+  readi(v->f->ip, mem, v->off + ((uint)a - v->start), PGSIZE);
+  iunlock(v->f->ip);
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(mappages(proc->pgdir, a, PGSIZE, PADDR(mem), perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Check that the current process may access va..va+n, which is
+// not part of its heap, for writing if write is set, and fault
+// in every page of it now, so that system calls never fault on
+// user memory.  The kernel's own stores ignore PTE_W, so this is
+// the only check on them.
+int
+mmapcheck(uint va, int n, int write)
+{
+  struct vma *v;
+  pte_t *pte;
+  uint a;
+
+  if(n < 0 || (v = findvma(proc, va)) == 0)
+    return -1;
+  if(write && !(v->prot & PROT_WRITE))
+    return -1;
+  if(va + n < va || va + n > v->start + v->len)
+    return -1;
+  for(a = (uint)PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(proc->pgdir, (char*)a, 0);
+    if((pte == 0 || !(*pte & PTE_P)) && mmapfault(a, write) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Write the page at va, which holds mem, back to v's file.
+// Do not extend the file.
+static void
+writeback(struct vma *v, uint va, char *mem)
+{
+  struct inode *ip;
+  uint off, n;
+
+  ip = v->f->ip;
+  off = v->off + (va - v->start);
+  begin_op();
+  ilock(ip);
+  if(off < ip->size){
+    n = ip->size - off;
+    if(n > PGSIZE)
+      n = PGSIZE;
+    writei(ip, mem, off, n);
+  }
+  iunlock(ip);
+  end_op();
+}
+
+// Write back the dirty pages of v in start..end, if v is shared,
+// and then, if unmap is set, free and unmap them.
+static void
+flushpages(struct proc *p, struct vma *v, uint start, uint end, int unmap)
+{
+  pte_t *pte;
+  uint a;
+  char *mem;
+
+  for(a = start; a < end; a += PGSIZE){
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte == 0 || !(*pte & PTE_P))
+      continue;
+    mem = (char*)PTE_ADDR(*pte);
+    if((v->flags & MAP_SHARED) && (v->prot & PROT_WRITE) &&
+       (*pte & PTE_D)){
+      writeback(v, a, mem);
+      *pte &= ~PTE_D;
+    }
+    if(unmap){
+      kfree(mem);
+      *pte = 0;
+    }
+  }
+  lcr3(PADDR(p->pgdir));  // flush the TLB
+}
+
+// Map n bytes of file f, starting at page-aligned offset off,
+// into the current process.  Return the address, or -1.
+int
+mmap(struct file *f, int n, int prot, int flags, int off)
+{
+  struct vma *v, *free;
+  uint end, start;
+
+  if(n <= 0 || off < 0 || off % PGSIZE != 0)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if(f->type != FD_INODE || f->ip->type != T_FILE || !f->readable)
+    return -1;
+  if((prot & PROT_WRITE) && flags == MAP_SHARED && !f->writable)
+    return -1;
+  n = PGROUNDUP(n);
+
+  free = 0;
+  for(v = proc->vma; v < &proc->vma[NVMA]; v++)
+    if(v->f == 0){
+      free = v;
+      break;
+    }
+  if(free == 0)
+    return -1;
+
+  // Take the highest gap below USERTOP that fits.
+  end = USERTOP;
+  for(;;){
+    if(end < n || end - n < PGROUNDUP(proc->sz))
+      return -1;
+    start = end - n;
+    for(v = proc->vma; v < &proc->vma[NVMA]; v++)
+      if(v->f && v->start < end && start < v->start + v->len)
+        break;
+    if(v == &proc->vma[NVMA])
+      break;
+    end = v->start;
+  }
+
+  free->f = filedup(f);
+  free->start = start;
+  free->len = n;
+  free->off = off;
+  free->prot = prot;
+  free->flags = flags;
+  return start;
+}
+
+// Unmap va..va+n, which must lie within one region, writing
+// shared pages back first.  Unmapping the middle of a region
+// splits it in two.
+int
+munmap(uint va, int n)
+{
+  struct vma *v, *w;
+  uint end, vend;
+
+  if(n <= 0 || va % PGSIZE != 0 || (v = findvma(proc, va)) == 0)
+    return -1;
+  end = va + PGROUNDUP(n);
+  vend = v->start + v->len;
+  if(end < va || end > vend)
+    return -1;
+
+  w = 0;
+  if(va > v->start && end < vend){
+    for(w = proc->vma; w < &proc->vma[NVMA]; w++)
+      if(w->f == 0)
+        break;
+    if(w == &proc->vma[NVMA])
+      return -1;
+  }
+
+  flushpages(proc, v, va, end, 1);
+  if(w){
+    *w = *v;
+    filedup(w->f);
+    w->start = end;
+    w->off = v->off + (end - v->start);
+    w->len = vend - end;
+    v->len = va - v->start;
+  } else if(va == v->start && end == vend){
+    fileclose(v->f);
+    v->f = 0;
+  } else if(va == v->start){
+    v->off += end - va;
+    v->start = end;
+    v->len = vend - end;
+  } else
+    v->len = va - v->start;
+  return 0;
+}
+
+// Write the dirty pages of va..va+n, which must lie within one
+// shared region, back to the file.
+int
+msync(uint va, int n)
+{
+  struct vma *v;
+  uint end;
+
+  if(n <= 0 || (v = findvma(proc, va)) == 0)
+    return -1;
+  end = PGROUNDUP(va + n);
+  if(end < va || end > v->start + v->len)
+    return -1;
+  if(v->flags & MAP_SHARED)
+    flushpages(proc, v, (uint)PGROUNDDOWN(va), end, 0);
+  return 0;
+}
+
+// Unmap every region of p, which is the current process,
+// as exec and exit must.
+void
+munmapall(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->f == 0)
+      continue;
+    flushpages(p, v, v->start, v->start + v->len, 1);
+    fileclose(v->f);
+    v->f = 0;
+  }
+}
+
+// Give child np copies of the current process's regions,
+// including the pages the parent has touched in private ones.
+int
+mmapfork(struct proc *np)
+{
+  struct vma *v, *nv;
+  pte_t *pte;
+  uint a;
+  char *mem;
+
+  for(v = proc->vma, nv = np->vma; v < &proc->vma[NVMA]; v++, nv++){
+    if(v->f == 0)
+      continue;
+    *nv = *v;
+    filedup(nv->f);
+    if(v->flags & MAP_SHARED)
+      continue;
+    for(a = v->start; a < v->start + v->len; a += PGSIZE){
+      pte = walkpgdir(proc->pgdir, (char*)a, 0);
+      if(pte == 0 || !(*pte & PTE_P))
+        continue;
+      if((mem = kalloc()) == 0)
+        goto bad;
+      memmove(mem, (char*)PTE_ADDR(*pte), PGSIZE);
+      if(mappages(np->pgdir, (char*)a, PGSIZE, PADDR(mem),
+                  PTE_FLAGS(*pte) & (PTE_W|PTE_U)) < 0){
+        kfree(mem);
+        goto bad;
+      }
+    }
+  }
+  return 0;
+
+bad:
+  // The caller frees np's pages with its page table.
+  for(nv = np->vma; nv < &np->vma[NVMA]; nv++){
+    if(nv->f){
+      fileclose(nv->f);
+      nv->f = 0;
+    }
+  }
+  return -1;
+}
@@ -39,6 +39,14 @@
 #define CR0_CD		0x40000000	// Cache Disable
 #define CR0_PG		0x80000000	// Paging
 
+// CPUID 1 %edx feature flags
+#define CPUID_SEP	0x00000800	// sysenter/sysexit
+
+// Model-specific registers
+#define MSR_SYSENTER_CS		0x174	// kernel %cs (and %ss, %cs+8)
+#define MSR_SYSENTER_ESP	0x175	// kernel %esp
+#define MSR_SYSENTER_EIP	0x176	// kernel entry point
+
 // Segment Descriptor
 struct segdesc {
   uint lim_15_0 : 16;  // Low bits of segment limit
@@ -138,6 +146,10 @@ struct segdesc {
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)	((uint)(pte) & ~0xFFF)
+#define PTE_FLAGS(pte)	((uint)(pte) &  0xFFF)
+
+// Page fault error code bits
+#define FEC_WR		0x2	// Fault caused by a write
 
 typedef uint pte_t;
 
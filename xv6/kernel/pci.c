@@ -0,0 +1,102 @@
+// PCI configuration space access using configuration mechanism #1.
+// Only enough to let drivers find their controller, read its
+// base address registers and turn on bus mastering.
+
+#include "types.h"
+#include "defs.h"
+#include "x86.h"
+#include "pci.h"
+
+#define PCI_CONFADDR  0xCF8
+#define PCI_CONFDATA  0xCFC
+
+static uint
+confaddr(struct pcidev *d, int off)
+{
+  return 0x80000000 | (d->bus << 16) | (d->dev << 11) |
+         (d->func << 8) | (off & 0xFC);
+}
+
+uint
+pciconfread(struct pcidev *d, int off)
+{
+  outl(PCI_CONFADDR, confaddr(d, off));
+  return inl(PCI_CONFDATA);
+}
+
+void
+pciconfwrite(struct pcidev *d, int off, uint v)
+{
+  outl(PCI_CONFADDR, confaddr(d, off));
+  outl(PCI_CONFDATA, v);
+}
+
+// Fill in the rest of d from its configuration header.
+static void
+pciload(struct pcidev *d, uint id)
+{
+  uint class;
+  int i;
+
+  d->vendor = id & 0xFFFF;
+  d->device = id >> 16;
+  class = pciconfread(d, PCI_CLASS);
+  d->class = class >> 24;
+  d->subclass = (class >> 16) & 0xFF;
+  d->progif = (class >> 8) & 0xFF;
+  d->irq = pciconfread(d, PCI_INTR) & 0xFF;
+  for(i = 0; i < 6; i++)
+    d->bar[i] = pciconfread(d, PCI_BAR0 + 4*i);
+}
+
+// Walk bus 0 (where QEMU and Bochs put every device) and return
+// the first function whose config word at reg matches val under mask.
+// Returns 0 on success, -1 if nothing matched.
+static int
+pcifind(int reg, uint mask, uint val, struct pcidev *d)
+{
+  uint id;
+  int nfunc;
+
+  d->bus = 0;
+  for(d->dev = 0; d->dev < 32; d->dev++){
+    nfunc = 1;
+    for(d->func = 0; d->func < nfunc; d->func++){
+      id = pciconfread(d, PCI_ID);
+      if((id & 0xFFFF) == 0xFFFF)
+        continue;
+      if(d->func == 0 && (pciconfread(d, PCI_HDR) & PCI_HDR_MF))
+        nfunc = 8;
+      if((pciconfread(d, reg) & mask) == val){
+        pciload(d, id);
+        return 0;
+      }
+    }
+  }
+  return -1;
+}
+
+// Find a function by vendor and device id.
+int
+pcifindid(ushort vendor, ushort device, struct pcidev *d)
+{
+  return pcifind(PCI_ID, 0xFFFFFFFF, (device << 16) | vendor, d);
+}
+
+// Find a function by class and subclass.
+int
+pcifindclass(uchar class, uchar subclass, struct pcidev *d)
+{
+  return pcifind(PCI_CLASS, 0xFFFF0000, (class << 24) | (subclass << 16), d);
+}
+
+// Turn on I/O and memory decoding and bus mastering for d.
+void
+pcienable(struct pcidev *d)
+{
+  uint cmd;
+
+  cmd = pciconfread(d, PCI_CMD);
+  cmd |= PCI_CMD_IO | PCI_CMD_MEM | PCI_CMD_MASTER;
+  pciconfwrite(d, PCI_CMD, cmd & 0xFFFF);
+}
@@ -0,0 +1,32 @@
+#ifndef _PCI_H_
+#define _PCI_H_
+// PCI configuration space layout (type 0 header).
+
+#define PCI_ID          0x00    // vendor (low 16) and device (high 16) id
+#define PCI_CMD         0x04    // command (low 16) and status (high 16)
+  #define PCI_CMD_IO      0x0001  // respond to I/O space accesses
+  #define PCI_CMD_MEM     0x0002  // respond to memory space accesses
+  #define PCI_CMD_MASTER  0x0004  // allow bus mastering (DMA)
+#define PCI_CLASS       0x08    // revision, prog-if, subclass, class
+#define PCI_HDR         0x0C    // cache line, latency, header type, BIST
+  #define PCI_HDR_MF      0x00800000  // multi-function device
+#define PCI_BAR0        0x10    // base address registers 0..5
+#define PCI_INTR        0x3C    // interrupt line (low 8) and pin
+
+#define PCI_BAR_IO      0x1     // BAR refers to I/O space
+
+// A function found on the bus.
+struct pcidev {
+  uchar bus;
+  uchar dev;
+  uchar func;
+  ushort vendor;
+  ushort device;
+  uchar class;
+  uchar subclass;
+  uchar progif;
+  uchar irq;          // legacy interrupt line assigned by the BIOS
+  uint bar[6];
+};
+
+#endif // _PCI_H_
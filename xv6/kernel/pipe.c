@@ -5,23 +5,45 @@
 #include "proc.h"
 #include "fs.h"
 #include "file.h"
+#include "uio.h"
 #include "spinlock.h"
 
-#define PIPESIZE 512
+// The buffer is PIPEPAGES separately allocated pages used as one
+// ring of PIPESIZE bytes.  nread and nwrite run freely and are
+// reduced to a ring offset by masking, so PIPEPAGES must be a
+// power of two.
+#define PIPESIZE (PIPEPAGES*PGSIZE)
+
+#if PIPEPAGES & (PIPEPAGES-1)
+#error PIPEPAGES must be a power of two
+#endif
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *data[PIPEPAGES];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
 };
 
+static void
+pipefree(struct pipe *p)
+{
+  int i;
+
+  for(i = 0; i < PIPEPAGES; i++)
+    if(p->data[i])
+      kfree(p->data[i]);
+  lockfree(&p->lock);
+  kfree((char*)p);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
   struct pipe *p;
+  int i;
 
   p = 0;
   *f0 = *f1 = 0;
@@ -29,6 +51,10 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((p = (struct pipe*)kalloc()) == 0)
     goto bad;
+  memset(p->data, 0, sizeof(p->data));
+  for(i = 0; i < PIPEPAGES; i++)
+    if((p->data[i] = kalloc()) == 0)
+      goto bad;
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
@@ -46,7 +72,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(p)
-    kfree((char*)p);
+    pipefree(p);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -67,37 +93,178 @@ pipeclose(struct pipe *p, int writable)
   }
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    pipefree(p);
   } else
     release(&p->lock);
 }
 
+// Return the longest run of the ring starting at byte count off
+// that lies within one page, capped at n.
+static int
+piperun(uint off, int n, char **pp, struct pipe *p)
+{
+  uint i;
+  int m;
+
+  i = off & (PIPESIZE-1);
+  *pp = p->data[i >> PGSHIFT] + (i & (PGSIZE-1));
+  m = PGSIZE - (i & (PGSIZE-1));
+  return m < n ? m : n;
+}
+
+// Copy up to n bytes from src into the free part of the ring,
+// one memmove per contiguous run, and return the count.
+// Readers can only be asleep when the ring is empty, so wake
+// them only when this makes it non-empty.  Caller holds p->lock.
+static int
+pipecopyin(struct pipe *p, char *src, int n)
+{
+  int i, k, m;
+  char *d;
+
+  m = p->nread + PIPESIZE - p->nwrite;
+  if(m > n)
+    m = n;
+  if(m > 0 && p->nread == p->nwrite)
+    wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+  for(i = 0; i < m; i += k){
+    k = piperun(p->nwrite, m - i, &d, p);
+    memmove(d, src + i, k);
+    p->nwrite += k;
+  }
+  return m;
+}
+
+// Write all n bytes, sleeping only when the ring is full.
 int
 pipewrite(struct pipe *p, char *addr, int n)
 {
   int i;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
+  for(i = 0; i < n; ){
     while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
       if(p->readopen == 0 || proc->killed){
         release(&p->lock);
         return -1;
       }
-      wakeup(&p->nread);
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    i += pipecopyin(p, addr + i, n - i);
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
   release(&p->lock);
   return n;
 }
 
+// Sleep until p has room.  Return -1 if nobody will ever
+// read it, or if the caller has been killed.
 int
-piperead(struct pipe *p, char *addr, int n)
+pipewait(struct pipe *p)
 {
-  int i;
+  acquire(&p->lock);
+  while(p->nwrite == p->nread + PIPESIZE && p->readopen && !proc->killed)
+    sleep(&p->nwrite, &p->lock);
+  if(p->readopen == 0 || proc->killed){
+    release(&p->lock);
+    return -1;
+  }
+  release(&p->lock);
+  return 0;
+}
+
+// Copy up to n bytes from kernel memory into p without sleeping.
+// Return the number copied, which is short if p fills up,
+// or -1 if nobody will ever read it.
+int
+pipeput(struct pipe *p, char *src, int n)
+{
+  int m;
+
+  acquire(&p->lock);
+  if(p->readopen == 0){
+    release(&p->lock);
+    return -1;
+  }
+  m = pipecopyin(p, src, n);
+  release(&p->lock);
+  return m;
+}
+
+// Move up to n bytes from pipe in straight into pipe out.
+// Like piperead, wait for in to have data and return 0 at
+// end of file; like pipewrite, wait for out to have room.
+// Return the number moved, which may be short.
+int
+pipesplice(struct pipe *in, struct pipe *out, int n)
+{
+  struct pipe *a, *b;
+  int i, k, m;
+  char *s, *d;
+
+  if(in == out)
+    return -1;
+  for(;;){
+    acquire(&in->lock);
+    while(in->nread == in->nwrite && in->writeopen){
+      if(proc->killed){
+        release(&in->lock);
+        return -1;
+      }
+      sleep(&in->nread, &in->lock);
+    }
+    if(in->nread == in->nwrite){
+      release(&in->lock);
+      return 0;
+    }
+    release(&in->lock);
+    if(pipewait(out) < 0)
+      return -1;
+
+    // Hold both locks, taken in address order.
+    a = in < out ? in : out;
+    b = in < out ? out : in;
+    acquire(&a->lock);
+    acquire(&b->lock);
+    if(out->readopen == 0){
+      release(&b->lock);
+      release(&a->lock);
+      return -1;
+    }
+    m = in->nwrite - in->nread;
+    if(m > out->nread + PIPESIZE - out->nwrite)
+      m = out->nread + PIPESIZE - out->nwrite;
+    if(m > n)
+      m = n;
+    if(m > 0){
+      if(in->nwrite == in->nread + PIPESIZE)
+        wakeup(&in->nwrite);
+      if(out->nread == out->nwrite)
+        wakeup(&out->nread);
+    }
+    for(i = 0; i < m; i += k){
+      k = piperun(in->nread, m - i, &s, in);
+      k = piperun(out->nwrite, k, &d, out);
+      memmove(d, s, k);
+      in->nread += k;
+      out->nwrite += k;
+    }
+    release(&b->lock);
+    release(&a->lock);
+    // Someone else may have drained in or filled out
+    // while no lock was held; if so, wait again.
+    if(m > 0 || n == 0)
+      return m;
+  }
+}
+
+// Copy out whatever is buffered, filling iov[0..cnt) in turn.
+// Writers can only be asleep when the ring is full, so wake them
+// only when this read frees space in a full ring.
+int
+pipereadv(struct pipe *p, struct iovec *iov, int cnt)
+{
+  int i, j, k, n, tot;
+  char *d;
 
   acquire(&p->lock);
   while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
@@ -107,12 +274,30 @@ piperead(struct pipe *p, char *addr, int n)
     }
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  if(p->nread != p->nwrite && p->nwrite == p->nread + PIPESIZE)
+    wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  tot = 0;
+  for(j = 0; j < cnt && p->nread != p->nwrite; j++){
+    n = iov[j].len;
+    if(n > p->nwrite - p->nread)
+      n = p->nwrite - p->nread;
+    for(i = 0; i < n; i += k){  //DOC: piperead-copy
+      k = piperun(p->nread, n - i, &d, p);
+      memmove((char*)iov[j].base + i, d, k);
+      p->nread += k;
+    }
+    tot += n;
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
   release(&p->lock);
-  return i;
+  return tot;
+}
+
+int
+piperead(struct pipe *p, char *addr, int n)
+{
+  struct iovec iov;
+
+  iov.base = addr;
+  iov.len = n;
+  return pipereadv(p, &iov, 1);
 }
@@ -5,11 +5,20 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "traps.h"
+#include "vdata.h"
 #include "pstat.h"
 
+// Sleeping processes are kept on wait queues hashed by channel,
+// so wakeup looks only at processes that might be sleeping on
+// its channel.
+#define NWAITQ     64
+#define WAITQSHIFT  6   // log2(NWAITQ)
+
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct proc *waitq[NWAITQ];  // sleepers, by hash of chan
 } ptable;
 
 static struct proc *initproc;
@@ -19,6 +28,7 @@ extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static void kick(void);
 
 void
 pinit(void)
@@ -154,6 +164,8 @@ growproc(int n)
   
   sz = proc->sz;
   if(n > 0){
+    if(sz + n > mmapfloor(proc))  // keep below mmap'd files
+      return -1;
     if((sz = allocuvm(proc->pgdir, sz, sz + n)) == 0)
       return -1;
   } else if(n < 0){
@@ -186,6 +198,13 @@ fork(void)
     return -1;
   }
   np->sz = proc->sz;
+  if(mmapfork(np) < 0){
+    freevm(np->pgdir);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
   np->parent = proc;
   *np->tf = *proc->tf;
 
@@ -199,6 +218,7 @@ fork(void)
  
   pid = np->pid;
   np->state = RUNNABLE;
+  kick();
   safestrcpy(np->name, proc->name, sizeof(proc->name));
   return pid;
 }
@@ -215,7 +235,8 @@ exit(void)
   if(proc == initproc)
     panic("init exiting");
 
-  // Close all open files.
+  // Write back mapped files, then close all open files.
+  munmapall(proc);
   for(fd = 0; fd < NOFILE; fd++){
     if(proc->ofile[fd]){
       fileclose(proc->ofile[fd]);
@@ -223,7 +244,9 @@ exit(void)
     }
   }
 
+  begin_op();
   iput(proc->cwd);
+  end_op();
   proc->cwd = 0;
 
   acquire(&ptable.lock);
@@ -320,6 +343,38 @@ struct proc * get_lproc(void)
 	return p;
 }
 
+// Nothing is runnable: halt until an interrupt, with the timer
+// set for the next deadline instead of the next tick.  kick()
+// interrupts an idle CPU when it makes a process runnable.
+static void
+idle(void)
+{
+  struct proc *p;
+  uint64 next;
+
+  acquire(&tickslock);
+  next = nextevent(1);
+  release(&tickslock);
+  lapictimer(next);
+
+  cli();
+  cpu->idle = 1;
+  __sync_synchronize();
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->state == RUNNABLE)
+      break;
+  if(p == &ptable.proc[NPROC])
+    stihlt();
+  cpu->idle = 0;
+  sti();
+
+  // Back to ticking, to preempt whatever runs next.
+  acquire(&tickslock);
+  next = nextevent(0);
+  release(&tickslock);
+  lapictimer(next);
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -372,8 +427,11 @@ scheduler(void)
       proc = p;
       switchuvm(p);
       p->state = RUNNING;
+      vdata->cpu[cpu->id].nswitch++;
+      vdata->cpu[cpu->id].pid = p->pid;
       swtch(&cpu->scheduler, proc->context);
       switchkvm();
+      vdata->cpu[cpu->id].pid = 0;
 
       p->n_schedule++;
 
@@ -383,6 +441,8 @@ scheduler(void)
     }
     release(&ptable.lock);
 
+    if(p == NULL)
+      idle();
   }
 }
 
@@ -446,17 +506,35 @@ yield(void)
 void
 forkret(void)
 {
+  static int first = 1;
+
   // Still holding ptable.lock from scheduler.
   release(&ptable.lock);
+
+  if(first){
+    // The log must be recovered in the context of a regular
+    // process, since it sleeps, and before any file system call.
+    first = 0;
+    initlog(ROOTDEV);
+  }
   
   // Return to "caller", actually trapret (see allocproc).
 }
 
+// Return the wait queue for chan.
+static struct proc**
+waitq(void *chan)
+{
+  return &ptable.waitq[((uint)chan * 2654435761U) >> (32 - WAITQSHIFT)];
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
+  struct proc **q, **pp;
+
   if(proc == 0)
     panic("sleep");
 
@@ -475,11 +553,18 @@ sleep(void *chan, struct spinlock *lk)
   }
 
   // Go to sleep.
+  q = waitq(chan);
   proc->chan = chan;
+  proc->qnext = *q;
+  *q = proc;
   proc->state = SLEEPING;
   sched();
 
-  // Tidy up.
+  // Tidy up.  Whoever woke us (wakeup or kill) left us queued.
+  for(pp = q; *pp != proc; pp = &(*pp)->qnext)
+    ;
+  *pp = proc->qnext;
+  proc->qnext = 0;
   proc->chan = 0;
 
   // Reacquire original lock.
@@ -497,8 +582,9 @@ wakeup1(void *chan)
   struct proc *p;
   struct proc *ps; //pass value search process pointer
   int foundlock = 0;
+  int woke = 0;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  for(p = *waitq(chan); p; p = p->qnext)
   {
     foundlock = 0;
 
@@ -533,8 +619,25 @@ wakeup1(void *chan)
         }
       } 
       p->state = RUNNABLE;
+      woke = 1;
     }
   }
+  if(woke)
+    kick();
+}
+
+// A process has just become runnable: interrupt the idle
+// CPUs so that one of them runs it.  Pairs with the barrier in
+// idle(): either the idle CPU sees the process or we see the CPU.
+static void
+kick(void)
+{
+  struct cpu *c;
+
+  __sync_synchronize();
+  for(c = cpus; c < cpus+ncpu; c++)
+    if(c->idle && c != cpu)
+      lapicipi(c->id, T_IRQ0 + IRQ_WAKE);
 }
 
 // Wake up all processes sleeping on chan.
@@ -559,8 +662,10 @@ kill(int pid)
     if(p->pid == pid){
       p->killed = 1;
       // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
+      if(p->state == SLEEPING){
         p->state = RUNNABLE;
+        kick();
+      }
       release(&ptable.lock);
       return 0;
     }
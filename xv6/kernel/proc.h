@@ -2,13 +2,44 @@
 #define _PROC_H_
 // Segments in proc->gdt.
 // Also known to bootasm.S and trapasm.S
+// sysexit requires the user segments to follow the
+// kernel's, in this order.
 #define SEG_KCODE 1  // kernel code
 #define SEG_KDATA 2  // kernel data+stack
-#define SEG_KCPU  3  // kernel per-cpu data
-#define SEG_UCODE 4  // user code
-#define SEG_UDATA 5  // user data+stack
+#define SEG_UCODE 3  // user code
+#define SEG_UDATA 4  // user data+stack
+#define SEG_KCPU  5  // kernel per-cpu data
 #define SEG_TSS   6  // this process's task state
-#define NSEGS     7
+#define SEG_UCPU  7  // limit is the CPU number; see vdata.h
+#define NSEGS     8
+
+// A file region mapped into a process by mmap.  Pages are
+// filled from the file on first touch.
+struct vma {
+  struct file *f;     // 0 if the slot is free
+  uint start;         // page-aligned user address
+  uint len;           // a multiple of PGSIZE
+  uint off;           // file offset of start
+  int prot;           // PROT_READ, PROT_WRITE
+  int flags;          // MAP_SHARED or MAP_PRIVATE
+};
+
+// A deadline in ticks, kept on the timer wheel (timerwheel.c).
+// When it expires, the wheel wakes chan.
+struct timer {
+  uint expires;         // tick at which to fire
+  void *chan;           // wakeup(chan) then
+  struct timer *next;   // rest of this wheel slot
+  struct timer **pprev; // what points at us; 0 if not pending
+};
+
+// A deadline in nanoseconds (timerwheel.c), for nanosleep.
+struct hrtimer {
+  uint64 when;          // nsecs() at which to fire
+  void *chan;           // wakeup(chan) then
+  struct hrtimer *next; // next later deadline
+  int pending;
+};
 
 // Per-CPU state
 struct cpu {
@@ -19,6 +50,8 @@ struct cpu {
   volatile uint booted;        // Has the CPU started?
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
+  volatile int idle;           // Halted in scheduler, waiting for work
+  int sysenter;                // Has sysenter; see idtinit
 
   // Cpu-local storage variables; see below
   struct cpu *cpu;
@@ -70,10 +103,14 @@ struct proc {
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
+  struct proc *qnext;          // Next on chan's wait queue
+  struct timer timer;          // sys_sleep deadline
+  struct hrtimer hrtimer;      // nanosleep deadline
   int killed;                  // If non-zero, have been killed
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct vma vma[NVMA];        // Memory-mapped files
 
   long tickets;	// number of tickets assigned to this process
   long pass;	// current pass value for the process
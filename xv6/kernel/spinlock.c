@@ -8,60 +8,143 @@
 #include "proc.h"
 #include "spinlock.h"
 
+#define NLOCKTAB   128  // locks lockdump can report on
+#define BACKOFF     50  // pause loops per waiter ahead of us
+
+// Every initialized lock, for lockdump.  The table's own lock
+// is ready without initlock (zero is a free ticket lock).
+static struct {
+  struct spinlock lock;
+  struct spinlock *locks[NLOCKTAB];
+} locktab = { { .name = "locktab" } };
+
 void
 initlock(struct spinlock *lk, char *name)
 {
+  struct spinlock **l, **free;
+
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->nacquire = 0;
+  lk->ncontend = 0;
+  lk->nspin = 0;
+  lk->maxhold = 0;
+
+  acquire(&locktab.lock);
+  free = 0;
+  for(l = locktab.locks; l < &locktab.locks[NLOCKTAB]; l++){
+    if(*l == lk)
+      break;
+    if(*l == 0 && free == 0)
+      free = l;
+  }
+  if(l == &locktab.locks[NLOCKTAB] && free)
+    *free = lk;
+  release(&locktab.lock);
+}
+
+// Forget lk, which is about to be freed.
+void
+lockfree(struct spinlock *lk)
+{
+  struct spinlock **l;
+
+  acquire(&locktab.lock);
+  for(l = locktab.locks; l < &locktab.locks[NLOCKTAB]; l++)
+    if(*l == lk)
+      *l = 0;
+  release(&locktab.lock);
 }
 
 // Acquire the lock.
-// Loops (spins) until the lock is acquired.
+// Takes a ticket and spins until that ticket is served.
 // Holding a lock for a long time may cause
 // other CPUs to waste time spinning to acquire it.
 void
 acquire(struct spinlock *lk)
 {
+  uint t, ahead, spins;
+  int i;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
+  // The locked xadd is atomic.
   // It also serializes, so that reads after acquire are not
-  // reordered before it. 
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // reordered before it.
+  t = fetchadd(&lk->next, 1);
+
+  // Back off in proportion to the number of CPUs ahead of us,
+  // rather than re-reading owner as fast as possible: every
+  // read of a line another CPU is writing costs a bus trip.
+  spins = 0;
+  while((ahead = t - *(volatile uint*)&lk->owner) != 0){
+    for(i = ahead * BACKOFF; i > 0; i--)
+      pause();
+    spins += ahead * BACKOFF;
+  }
+  __sync_synchronize();
 
-  // Record info about lock acquisition for debugging.
   lk->cpu = cpu;
+  lk->nacquire++;
+  if(spins){
+    lk->ncontend++;
+    lk->nspin += spins;
+  }
+  lk->tstart = rdtsc();
+#ifdef LOCKDEBUG
+  // Record info about lock acquisition for debugging.
   getcallerpcs(&lk, lk->pcs);
+#endif
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  uint held;
+
   if(!holding(lk))
     panic("release");
 
+  held = rdtsc() - lk->tstart;
+  if(held > lk->maxhold)
+    lk->maxhold = held;
+#ifdef LOCKDEBUG
   lk->pcs[0] = 0;
+#endif
   lk->cpu = 0;
 
-  // The xchg serializes, so that reads before release are 
-  // not reordered after it.  The 1996 PentiumPro manual (Volume 3,
-  // 7.2) says reads can be carried out speculatively and in
-  // any order, which implies we need to serialize here.
-  // But the 2007 Intel 64 Architecture Memory Ordering White
-  // Paper says that Intel 64 and IA-32 will not move a load
-  // after a store. So lock->locked = 0 would work here.
-  // The xchg being asm volatile ensures gcc emits it after
-  // the above assignments (and after the critical section).
-  xchg(&lk->locked, 0);
+  // Serve the next ticket.  Only the holder writes owner, so a
+  // plain increment would do; the barrier keeps gcc and the CPU
+  // from moving the critical section's memory accesses past it.
+  __sync_synchronize();
+  lk->owner++;
 
   popcli();
 }
 
+// Print contention statistics for every lock that has been
+// waited for.  Runs when user types ^L on console.
+void
+lockdump(void)
+{
+  struct spinlock **l, *lk;
+
+  cprintf("lock: acquires contended spins max-hold-cycles\n");
+  acquire(&locktab.lock);
+  for(l = locktab.locks; l < &locktab.locks[NLOCKTAB]; l++){
+    if((lk = *l) == 0 || lk->ncontend == 0)
+      continue;
+    cprintf("%s: %d %d %d %d\n", lk->name, lk->nacquire, lk->ncontend,
+            lk->nspin, lk->maxhold);
+  }
+  release(&locktab.lock);
+}
+
 // Record the current call stack in pcs[] by following the %ebp chain.
 void
 getcallerpcs(void *v, uint pcs[])
@@ -84,7 +167,7 @@ getcallerpcs(void *v, uint pcs[])
 int
 holding(struct spinlock *lock)
 {
-  return lock->locked && lock->cpu == cpu;
+  return lock->next != lock->owner && lock->cpu == cpu;
 }
 
 
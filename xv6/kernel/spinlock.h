@@ -1,15 +1,27 @@
 #ifndef _SPINLOCK_H_
 #define _SPINLOCK_H_
 
-// Mutual exclusion lock.
+// Mutual exclusion lock.  A ticket lock: each acquirer takes the
+// next ticket and waits until it is served, so CPUs get the lock
+// in the order they asked for it.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Next ticket to hand out.
+  uint owner;        // Ticket now holding the lock.
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+#ifdef LOCKDEBUG
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+#endif
+
+  // Contention statistics, updated while holding the lock:
+  uint nacquire;     // Times acquired.
+  uint ncontend;     // Times an acquirer had to wait.
+  uint nspin;        // Total pause loops spent waiting.
+  uint tstart;       // Cycle counter when last acquired.
+  uint maxhold;      // Longest hold, in cycles.
 };
 
 #endif // _SPINLOCK_H_
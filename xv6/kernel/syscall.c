@@ -41,6 +41,21 @@ fetchstr(struct proc *p, uint addr, char **pp)
   return -1;
 }
 
+// Check that the size bytes at addr lie in process p's memory,
+// faulting in any mmap'd pages, and set *pp to point at them.
+// If write is set the kernel will store into them, so mmap'd
+// pages must be writable: the kernel ignores PTE_W.
+int
+fetchptr(struct proc *p, uint addr, int size, int write, char **pp)
+{
+  if(size < 0)
+    return -1;
+  if((addr >= p->sz || addr+size > p->sz) && mmapcheck(addr, size, write) < 0)
+    return -1;
+  *pp = (char*)addr;
+  return 0;
+}
+
 // Fetch the nth 32-bit system call argument.
 int
 argint(int n, int *ip)
@@ -58,10 +73,18 @@ argptr(int n, char **pp, int size)
   
   if(argint(n, &i) < 0)
     return -1;
-  if((uint)i >= proc->sz || (uint)i+size > proc->sz)
+  return fetchptr(proc, i, size, 0, pp);
+}
+
+// Like argptr, for a block the system call will write.
+int
+argwptr(int n, char **pp, int size)
+{
+  int i;
+
+  if(argint(n, &i) < 0)
     return -1;
-  *pp = (char*)i;
-  return 0;
+  return fetchptr(proc, i, size, 1, pp);
 }
 
 // Fetch the nth word-sized system call argument as a string pointer.
@@ -106,6 +129,17 @@ static int (*syscalls[])(void) = {
 [SYS_getprocs]	sys_getprocs,
 [SYS_settickets] sys_settickets,
 [SYS_getpinfo]	sys_getpinfo,
+[SYS_splice]	sys_splice,
+[SYS_readv]	sys_readv,
+[SYS_writev]	sys_writev,
+[SYS_pread]	sys_pread,
+[SYS_pwrite]	sys_pwrite,
+[SYS_mmap]	sys_mmap,
+[SYS_munmap]	sys_munmap,
+[SYS_msync]	sys_msync,
+[SYS_ringenter]	sys_ringenter,
+[SYS_nanosleep]	sys_nanosleep,
+[SYS_clock_gettime]	sys_clock_gettime,
 };
 
 // Called on a syscall trap. Checks that the syscall number (passed via eax)
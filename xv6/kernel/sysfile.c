@@ -7,6 +7,8 @@
 #include "fs.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
+#include "ring.h"
 #include "sysfunc.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
@@ -65,7 +67,7 @@ sys_read(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argwptr(1, &p, n) < 0)
     return -1;
   return fileread(f, p, n);
 }
@@ -82,26 +84,160 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// splice(in, out, n): move up to n bytes from in to out,
+// which must be a pipe, without copying through user memory.
 int
-sys_close(void)
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  if(n < 0)
+    return -1;
+  return filesplice(in, out, n);
+}
+
+// Fetch the nth and n+1th system call arguments as an array of
+// iovecs and their count.  Copy the array into iov, and check
+// every buffer it names before any I/O starts, for writing if
+// write is set.
+static int
+argiov(int n, struct iovec *iov, int *pcnt, int write)
+{
+  int i, cnt;
+  char *p;
+
+  if(argint(n+1, &cnt) < 0 || cnt < 0 || cnt > IOV_MAX)
+    return -1;
+  if(argptr(n, &p, cnt*sizeof(struct iovec)) < 0)
+    return -1;
+  memmove(iov, p, cnt*sizeof(struct iovec));
+  for(i = 0; i < cnt; i++){
+    if(fetchptr(proc, (uint)iov[i].base, iov[i].len, write, &p) < 0)
+      return -1;
+  }
+  *pcnt = cnt;
+  return 0;
+}
+
+int
+sys_readv(void)
 {
-  int fd;
   struct file *f;
-  
-  if(argfd(0, &fd, &f) < 0)
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt, 1) < 0)
+    return -1;
+  return filereadv(f, iov, cnt);
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt, 0) < 0)
+    return -1;
+  return filewritev(f, iov, cnt);
+}
+
+// pread(fd, buf, n, off): read at off without using or moving
+// the file's offset.
+int
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argwptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+// mmap(addr, n, prot, flags, fd, off): map n bytes of fd at
+// off.  addr is only a hint, and is ignored.
+int
+sys_mmap(void)
+{
+  struct file *f;
+  int n, prot, flags, off;
+
+  if(argint(1, &n) < 0 || argint(2, &prot) < 0 || argint(3, &flags) < 0 ||
+     argfd(4, 0, &f) < 0 || argint(5, &off) < 0)
+    return -1;
+  return mmap(f, n, prot, flags, off);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, n;
+
+  if(argint(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return munmap(addr, n);
+}
+
+int
+sys_msync(void)
+{
+  int addr, n;
+
+  if(argint(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return msync(addr, n);
+}
+
+// Close descriptor fd of the current process.
+static int
+fdclose(int fd)
+{
+  struct file *f;
+
+  if(fd < 0 || fd >= NOFILE || (f=proc->ofile[fd]) == 0)
     return -1;
   proc->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
 
+int
+sys_close(void)
+{
+  int fd;
+  
+  if(argint(0, &fd) < 0)
+    return -1;
+  return fdclose(fd);
+}
+
 int
 sys_fstat(void)
 {
   struct file *f;
   struct stat *st;
   
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argwptr(1, (void*)&st, sizeof(*st)) < 0)
     return -1;
   return filestat(f, st);
 }
@@ -115,11 +251,16 @@ sys_link(void)
 
   if(argstr(0, &old) < 0 || argstr(1, &new) < 0)
     return -1;
-  if((ip = namei(old)) == 0)
+
+  begin_op();
+  if((ip = namei(old)) == 0){
+    end_op();
     return -1;
+  }
   ilock(ip);
   if(ip->type == T_DIR){
     iunlockput(ip);
+    end_op();
     return -1;
   }
   ip->nlink++;
@@ -135,6 +276,7 @@ sys_link(void)
   }
   iunlockput(dp);
   iput(ip);
+  end_op();
   return 0;
 
 bad:
@@ -142,6 +284,7 @@ bad:
   ip->nlink--;
   iupdate(ip);
   iunlockput(ip);
+  end_op();
   return -1;
 }
 
@@ -152,10 +295,11 @@ isdirempty(struct inode *dp)
   int off;
   struct dirent de;
 
-  for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
+  // In a hashed directory "." and ".." can be in any bucket.
+  for(off=0; off<dp->size; off+=sizeof(de)){
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
       panic("isdirempty: readi");
-    if(de.inum != 0)
+    if(de.inum != 0 && namecmp(de.name, ".") != 0 && namecmp(de.name, "..") != 0)
       return 0;
   }
   return 1;
@@ -171,33 +315,33 @@ sys_unlink(void)
 
   if(argstr(0, &path) < 0)
     return -1;
-  if((dp = nameiparent(path, name)) == 0)
+
+  begin_op();
+  if((dp = nameiparent(path, name)) == 0){
+    end_op();
     return -1;
+  }
   ilock(dp);
 
   // Cannot unlink "." or "..".
-  if(namecmp(name, ".") == 0 || namecmp(name, "..") == 0){
-    iunlockput(dp);
-    return -1;
-  }
+  if(namecmp(name, ".") == 0 || namecmp(name, "..") == 0)
+    goto bad;
 
-  if((ip = dirlookup(dp, name, &off)) == 0){
-    iunlockput(dp);
-    return -1;
-  }
+  if((ip = dirlookup(dp, name, &off)) == 0)
+    goto bad;
   ilock(ip);
 
   if(ip->nlink < 1)
     panic("unlink: nlink < 1");
   if(ip->type == T_DIR && !isdirempty(ip)){
     iunlockput(ip);
-    iunlockput(dp);
-    return -1;
+    goto bad;
   }
 
   memset(&de, 0, sizeof(de));
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcacheremove(dp, name);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -207,7 +351,13 @@ sys_unlink(void)
   ip->nlink--;
   iupdate(ip);
   iunlockput(ip);
+  end_op();
   return 0;
+
+bad:
+  iunlockput(dp);
+  end_op();
+  return -1;
 }
 
 static struct inode*
@@ -247,32 +397,46 @@ create(char *path, short type, short major, short minor)
       panic("create dots");
   }
 
-  if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+  if(dirlink(dp, name, ip->inum) < 0){
+    // Directory is full; give the new inode back.
+    if(type == T_DIR){
+      dp->nlink--;
+      iupdate(dp);
+    }
+    iunlockput(dp);
+    ip->nlink = 0;
+    iupdate(ip);
+    iunlockput(ip);
+    return 0;
+  }
 
   iunlockput(dp);
   return ip;
 }
 
-int
-sys_open(void)
+// Open path with mode omode and return a new descriptor.
+static int
+fileopen(char *path, int omode)
 {
-  char *path;
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
-    return -1;
+  begin_op();
   if(omode & O_CREATE){
-    if((ip = create(path, T_FILE, 0, 0)) == 0)
+    if((ip = create(path, T_FILE, 0, 0)) == 0){
+      end_op();
       return -1;
+    }
   } else {
-    if((ip = namei(path)) == 0)
+    if((ip = namei(path)) == 0){
+      end_op();
       return -1;
-    ilock(ip);
+    }
+    ilockshared(ip);
     if(ip->type == T_DIR && omode != O_RDONLY){
       iunlockput(ip);
+      end_op();
       return -1;
     }
   }
@@ -281,9 +445,11 @@ sys_open(void)
     if(f)
       fileclose(f);
     iunlockput(ip);
+    end_op();
     return -1;
   }
   iunlock(ip);
+  end_op();
 
   f->type = FD_INODE;
   f->ip = ip;
@@ -293,15 +459,30 @@ sys_open(void)
   return fd;
 }
 
+int
+sys_open(void)
+{
+  char *path;
+  int omode;
+
+  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return fileopen(path, omode);
+}
+
 int
 sys_mkdir(void)
 {
   char *path;
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0)
+  begin_op();
+  if(argstr(0, &path) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
+    end_op();
     return -1;
+  }
   iunlockput(ip);
+  end_op();
   return 0;
 }
 
@@ -313,12 +494,16 @@ sys_mknod(void)
   int len;
   int major, minor;
   
+  begin_op();
   if((len=argstr(0, &path)) < 0 ||
      argint(1, &major) < 0 ||
      argint(2, &minor) < 0 ||
-     (ip = create(path, T_DEV, major, minor)) == 0)
+     (ip = create(path, T_DEV, major, minor)) == 0){
+    end_op();
     return -1;
+  }
   iunlockput(ip);
+  end_op();
   return 0;
 }
 
@@ -328,15 +513,20 @@ sys_chdir(void)
   char *path;
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || (ip = namei(path)) == 0)
+  begin_op();
+  if(argstr(0, &path) < 0 || (ip = namei(path)) == 0){
+    end_op();
     return -1;
-  ilock(ip);
+  }
+  ilockshared(ip);
   if(ip->type != T_DIR){
     iunlockput(ip);
+    end_op();
     return -1;
   }
   iunlock(ip);
   iput(proc->cwd);
+  end_op();
   proc->cwd = ip;
   return 0;
 }
@@ -374,7 +564,7 @@ sys_pipe(void)
   struct file *rf, *wf;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argwptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
@@ -390,3 +580,68 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+// Run one ring request, checking its arguments the way the
+// corresponding system call would.
+static int
+ringop(struct sqe *e)
+{
+  struct file *f;
+  char *p;
+
+  switch(e->op){
+  case RING_NOP:
+    return 0;
+  case RING_READ:
+  case RING_WRITE:
+    if(e->fd < 0 || e->fd >= NOFILE || (f=proc->ofile[e->fd]) == 0)
+      return -1;
+    if(fetchptr(proc, (uint)e->buf, e->n, e->op == RING_READ, &p) < 0)
+      return -1;
+    if(e->off >= 0){
+      if(e->op == RING_READ)
+        return filepread(f, p, e->n, e->off);
+      return filepwrite(f, p, e->n, e->off);
+    }
+    if(e->op == RING_READ)
+      return fileread(f, p, e->n);
+    return filewrite(f, p, e->n);
+  case RING_OPEN:
+    if(fetchstr(proc, (uint)e->buf, &p) < 0)
+      return -1;
+    return fileopen(p, e->n);
+  case RING_CLOSE:
+    return fdclose(e->fd);
+  }
+  return -1;
+}
+
+// ringenter(ring): run the requests queued in ring, in order,
+// all in this one trap.  There are no kernel threads to hand
+// them to, so they run here in the caller.  Return the number
+// run, which is short if the completion ring fills up or the
+// process is killed.
+int
+sys_ringenter(void)
+{
+  struct ring *r;
+  struct sqe e;
+  struct cqe *c;
+  int n;
+
+  if(argwptr(0, (char**)&r, sizeof(*r)) < 0)
+    return -1;
+  if(r->sqtail - r->sqhead > NRING || r->cqtail - r->cqhead > NRING)
+    return -1;
+  for(n = 0; r->sqhead != r->sqtail; n++){
+    if(r->cqtail - r->cqhead == NRING || proc->killed)
+      break;
+    e = r->sq[r->sqhead % NRING];
+    c = &r->cq[r->cqtail % NRING];
+    c->data = e.data;
+    c->res = ringop(&e);
+    r->sqhead++;
+    r->cqtail++;
+  }
+  return n;
+}
@@ -26,5 +26,16 @@ int sys_uptime(void);
 int sys_getprocs(void);
 int sys_settickets(void);
 int sys_getpinfo(void);
+int sys_splice(void);
+int sys_readv(void);
+int sys_writev(void);
+int sys_pread(void);
+int sys_pwrite(void);
+int sys_mmap(void);
+int sys_munmap(void);
+int sys_msync(void);
+int sys_ringenter(void);
+int sys_nanosleep(void);
+int sys_clock_gettime(void);
 
 #endif // _SYSFUNC_H_
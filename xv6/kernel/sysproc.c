@@ -5,6 +5,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "sysfunc.h"
+#include "time.h"
 
 int
 sys_fork(void)
@@ -65,13 +66,19 @@ sys_sleep(void)
     return -1;
   acquire(&tickslock);
   ticks0 = ticks;
+  proc->timer.expires = ticks0 + n;
+  proc->timer.chan = &proc->timer;
   while(ticks - ticks0 < n){
     if(proc->killed){
+      timerdel(&proc->timer);
       release(&tickslock);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    if(proc->timer.pprev == 0)
+      timeradd(&proc->timer);
+    sleep(&proc->timer, &tickslock);
   }
+  timerdel(&proc->timer);
   release(&tickslock);
   return 0;
 }
@@ -84,11 +91,58 @@ sys_uptime(void)
   uint xticks;
   
   acquire(&tickslock);
+  tickupdate();  // an idle CPU may not have counted them yet
   xticks = ticks;
   release(&tickslock);
   return xticks;
 }
 
+// Sleep for the time in *ts, to within the resolution of the
+// local APIC timer rather than a tick.
+int
+sys_nanosleep(void)
+{
+  struct timespec *ts;
+  struct hrtimer *h;
+  uint64 next;
+
+  if(argptr(0, (char**)&ts, sizeof(*ts)) < 0 || ts->nsec >= 1000000000)
+    return -1;
+  h = &proc->hrtimer;
+  acquire(&tickslock);
+  h->when = nsecs() + (uint64)ts->sec*1000000000 + ts->nsec;
+  h->chan = h;
+  hrtimeradd(h);
+  // The deadline may come before this CPU's next tick.
+  next = nextevent(0);
+  lapictimer(next);
+  while(h->pending){
+    if(proc->killed){
+      hrtimerdel(h);
+      release(&tickslock);
+      return -1;
+    }
+    sleep(h, &tickslock);
+  }
+  release(&tickslock);
+  return 0;
+}
+
+// Store the time since boot in *ts.
+int
+sys_clock_gettime(void)
+{
+  struct timespec *ts;
+  uint64 now;
+
+  if(argwptr(0, (char**)&ts, sizeof(*ts)) < 0)
+    return -1;
+  now = nsecs();
+  ts->sec = div64(now, 1000000000);
+  ts->nsec = now - (uint64)ts->sec*1000000000;
+  return 0;
+}
+
 //return the number of processes (iregardless of state)
 //exist
 int
@@ -143,7 +197,7 @@ sys_getpinfo(void)
 
 	//user auxillary helper function to take in usermode input
 	//and assign to p above
-	if(argptr(0, (char **)&p, sizeof(p)) < 0)
+	if(argwptr(0, (char **)&p, sizeof(p)) < 0)
 	{
 		//error in getting ptr
 		return -1;
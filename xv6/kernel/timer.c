@@ -1,6 +1,8 @@
 // Intel 8253/8254/82C54 Programmable Interval Timer (PIT).
-// Only used on uniprocessors;
+// Counter 0 interrupts only on uniprocessors;
 // SMP machines use the local APIC timer.
+// Counter 2 is used at boot to calibrate the cycle counter,
+// which then serves as the nanosecond clock.
 
 #include "types.h"
 #include "defs.h"
@@ -20,6 +22,17 @@
 #define TIMER_SEL0      0x00    // select counter 0
 #define TIMER_RATEGEN   0x04    // mode 2, rate generator
 #define TIMER_16BIT     0x30    // r/w counter 16 bits, LSB first
+#define TIMER_SEL2      0x80    // select counter 2
+#define TIMER_INTTC     0x00    // mode 0, interrupt on terminal count
+
+#define IO_TIMER2       (IO_TIMER1 + 2) // counter 2 count
+#define IO_PORTB        0x61            // counter 2 gate and output
+#define PORTB_GATE2     0x01
+#define PORTB_SPEAKER   0x02
+#define PORTB_OUT2      0x20
+
+static uint64 tsc0;       // cycle counter at clockinit
+static uint tscmult;      // ns per cycle, times 2^16
 
 void
 timerinit(void)
@@ -30,3 +43,44 @@ timerinit(void)
   outb(IO_TIMER1, TIMER_DIV(100) / 256);
   picenable(IRQ_TIMER);
 }
+
+// Busy-wait 10ms, timed by PIT counter 2.
+void
+pitwait(void)
+{
+  outb(IO_PORTB, (inb(IO_PORTB) & ~PORTB_SPEAKER) | PORTB_GATE2);
+  outb(TIMER_MODE, TIMER_SEL2 | TIMER_INTTC | TIMER_16BIT);
+  outb(IO_TIMER2, TIMER_DIV(100) % 256);
+  outb(IO_TIMER2, TIMER_DIV(100) / 256);
+  while((inb(IO_PORTB) & PORTB_OUT2) == 0)
+    ;
+}
+
+// Measure the cycle counter against the PIT and start the clock.
+void
+clockinit(void)
+{
+  uint64 t0, t1;
+  uint mhz;
+
+  t0 = rdtsc64();
+  pitwait();
+  t1 = rdtsc64();
+  mhz = div64(t1 - t0, 10000);  // cycles per microsecond
+  if(mhz == 0)
+    panic("clockinit");
+  tscmult = (1000 << 16) / mhz;
+  tsc0 = rdtsc64();
+  cprintf("clock: %d MHz\n", mhz);
+}
+
+// Nanoseconds since clockinit.
+uint64
+nsecs(void)
+{
+  uint64 c;
+
+  // Split c so the products cannot overflow.
+  c = rdtsc64() - tsc0;
+  return (c >> 16) * tscmult + (((c & 0xFFFF) * tscmult) >> 16);
+}
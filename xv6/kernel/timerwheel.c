@@ -0,0 +1,241 @@
+// Hierarchical timer wheel for tick deadlines (sys_sleep).
+//
+// A timer due within WHEELSIZE ticks sits in wheel0, in the slot
+// for its expiry tick.  One due within WHEELSIZE*WHEELSIZE ticks
+// sits in wheel1, in the slot for its expiry tick / WHEELSIZE;
+// each time the tick count crosses a multiple of WHEELSIZE, the
+// wheel1 slot for the new block moves down into wheel0.  Timers
+// further out wait on the later list, which is sorted back into
+// the wheels every WHEELSIZE*WHEELSIZE ticks.  Each tick costs
+// only the timers that actually expire, plus the occasional
+// cascade, however many processes are asleep.
+//
+// The tick count itself is derived from the nanosecond clock
+// (tickupdate), so a CPU that sleeps through many ticks catches
+// up when it wakes.  Deadlines finer than a tick (nanosleep) are
+// hrtimers, kept on a list sorted by deadline.  nextevent tells
+// a CPU when it next needs a timer interrupt: at the next tick if
+// it is running a process, otherwise only at the next deadline.
+//
+// Everything here is protected by tickslock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "vdata.h"
+
+#define WHEELBITS  6
+#define WHEELSIZE  (1<<WHEELBITS)
+#define WHEELMASK  (WHEELSIZE-1)
+
+#define NSPERTICK  10000000ULL   // 100 ticks a second
+#define NEVER      (~0ULL)
+
+static struct timer *wheel0[WHEELSIZE];
+static struct timer *wheel1[WHEELSIZE];
+static struct timer *later;
+static uint wheelnow;    // last tick processed
+static struct hrtimer *hrtimers;  // pending, soonest first
+
+static void
+tlink(struct timer **head, struct timer *t)
+{
+  t->next = *head;
+  if(*head)
+    (*head)->pprev = &t->next;
+  t->pprev = head;
+  *head = t;
+}
+
+static void
+tunlink(struct timer *t)
+{
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+  t->next = 0;
+  t->pprev = 0;
+}
+
+// Put t in the list for its expiry relative to wheelnow.
+static void
+tplace(struct timer *t)
+{
+  uint d;
+
+  d = t->expires - wheelnow;
+  if(d < WHEELSIZE)
+    tlink(&wheel0[t->expires & WHEELMASK], t);
+  else if(d < WHEELSIZE*WHEELSIZE)
+    tlink(&wheel1[(t->expires >> WHEELBITS) & WHEELMASK], t);
+  else
+    tlink(&later, t);
+}
+
+// Move every timer on list *head back through tplace.
+static void
+tcascade(struct timer **head)
+{
+  struct timer *t;
+
+  while((t = *head) != 0){
+    tunlink(t);
+    tplace(t);
+  }
+}
+
+// Arm t to wake t->chan at tick t->expires, which must be later
+// than the current tick.
+void
+timeradd(struct timer *t)
+{
+  if(!holding(&tickslock))
+    panic("timeradd");
+  if(t->pprev)
+    panic("timeradd: pending");
+  tplace(t);
+}
+
+// Disarm t, if it is pending.
+void
+timerdel(struct timer *t)
+{
+  if(!holding(&tickslock))
+    panic("timerdel");
+  if(t->pprev)
+    tunlink(t);
+}
+
+// Catch the wheels up to tick now, waking the channel of
+// every timer that expires.
+void
+timerexpire(uint now)
+{
+  struct timer *t, **slot;
+
+  if(!holding(&tickslock))
+    panic("timerexpire");
+  while(wheelnow != now){
+    wheelnow++;
+    if((wheelnow & WHEELMASK) == 0){
+      if(((wheelnow >> WHEELBITS) & WHEELMASK) == 0)
+        tcascade(&later);
+      tcascade(&wheel1[(wheelnow >> WHEELBITS) & WHEELMASK]);
+    }
+    slot = &wheel0[wheelnow & WHEELMASK];
+    while((t = *slot) != 0){
+      tunlink(t);
+      wakeup(t->chan);
+    }
+  }
+}
+
+// The first tick after wheelnow at which a timer might expire,
+// or 0 if none is pending.  A timer in wheel1 or on the later
+// list may need to cascade at the next multiple of WHEELSIZE.
+static uint
+timernext(void)
+{
+  uint t;
+  int i, far;
+
+  far = later != 0;
+  for(i = 0; i < WHEELSIZE; i++)
+    if(wheel1[i])
+      far = 1;
+  for(t = wheelnow + 1; t != wheelnow + WHEELSIZE; t++){
+    if(wheel0[t & WHEELMASK])
+      return t;
+    if((t & WHEELMASK) == 0 && far)
+      return t;
+  }
+  return far ? (wheelnow | WHEELMASK) + 1 : 0;
+}
+
+// Arm h to wake h->chan at nsecs() time h->when.
+void
+hrtimeradd(struct hrtimer *h)
+{
+  struct hrtimer **pp;
+
+  if(!holding(&tickslock))
+    panic("hrtimeradd");
+  if(h->pending)
+    panic("hrtimeradd: pending");
+  for(pp = &hrtimers; *pp && (*pp)->when <= h->when; pp = &(*pp)->next)
+    ;
+  h->next = *pp;
+  *pp = h;
+  h->pending = 1;
+}
+
+// Disarm h, if it is pending.
+void
+hrtimerdel(struct hrtimer *h)
+{
+  struct hrtimer **pp;
+
+  if(!holding(&tickslock))
+    panic("hrtimerdel");
+  if(!h->pending)
+    return;
+  for(pp = &hrtimers; *pp != h; pp = &(*pp)->next)
+    ;
+  *pp = h->next;
+  h->next = 0;
+  h->pending = 0;
+}
+
+// Bring ticks up to date with the clock and fire every timer
+// that is due.
+void
+tickupdate(void)
+{
+  uint64 now;
+  uint t;
+  struct hrtimer *h;
+
+  if(!holding(&tickslock))
+    panic("tickupdate");
+  now = nsecs();
+  t = div64(now, NSPERTICK);
+  // The cycle counters of different CPUs may disagree slightly;
+  // never let ticks run backwards.
+  if((int)(t - ticks) > 0){
+    ticks = t;
+    vdata->ticks = t;
+    timerexpire(ticks);
+  }
+  while((h = hrtimers) != 0 && h->when <= now){
+    hrtimers = h->next;
+    h->next = 0;
+    h->pending = 0;
+    wakeup(h->chan);
+  }
+}
+
+// When this CPU next needs a timer interrupt, in nsecs() time.
+// A busy CPU needs every tick, to preempt; an idle one only
+// needs the next deadline.
+uint64
+nextevent(int idle)
+{
+  uint64 next;
+  uint t;
+
+  if(!holding(&tickslock))
+    panic("nextevent");
+  if(!idle)
+    next = (ticks + 1) * NSPERTICK;
+  else if((t = timernext()) != 0)
+    next = t * NSPERTICK;
+  else
+    next = NEVER;
+  if(hrtimers && hrtimers->when < next)
+    next = hrtimers->when;
+  return next;
+}
@@ -25,15 +25,45 @@ tvinit(void)
   initlock(&tickslock, "time");
 }
 
+extern void sysentry(void);  // in trapasm.S
+
+#define SYSENTER  0x340F  // the instruction's bytes, as a ushort
+
 void
 idtinit(void)
 {
+  uint a, b, c, d;
+
   lidt(idt, sizeof(idt));
+
+  // Without sysenter, trap() emulates it.
+  cpuid(1, &a, &b, &c, &d);
+  if(!(d & CPUID_SEP))
+    return;
+  cpu->sysenter = 1;
+  wrmsr(MSR_SYSENTER_CS, SEG_KCODE<<3);
+  wrmsr(MSR_SYSENTER_EIP, (uint)sysentry);
+  wrmsr(MSR_SYSENTER_ESP, 0);  // switchuvm sets it
+}
+
+// A system call by sysenter, from sysentry in trapasm.S;
+// the same as the T_SYSCALL case of trap().
+void
+fastsyscall(struct trapframe *tf)
+{
+  if(proc->killed)
+    exit();
+  proc->tf = tf;
+  syscall();
+  if(proc->killed)
+    exit();
 }
 
 void
 trap(struct trapframe *tf)
 {
+  uint64 next;
+
   if(tf->trapno == T_SYSCALL){
     if(proc->killed)
       exit();
@@ -46,12 +76,17 @@ trap(struct trapframe *tf)
 
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpu->id == 0){
-      acquire(&tickslock);
-      ticks++;
-      wakeup(&ticks);
-      release(&tickslock);
-    }
+    // Any CPU's timer may be the only one running, so each
+    // brings the clock up to date and then arms itself again.
+    acquire(&tickslock);
+    tickupdate();
+    next = nextevent(0);
+    release(&tickslock);
+    lapictimer(next);
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_WAKE:
+    // kick(): the scheduler will find the runnable process.
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -75,8 +110,35 @@ trap(struct trapframe *tf)
             cpu->id, tf->cs, tf->eip);
     lapiceoi();
     break;
-   
+
+  case T_PGFLT:
+    // First touch of a page of an mmap'd file?
+    if(proc && (tf->cs&3) == DPL_USER && mmapfault(rcr2(), tf->err & FEC_WR) == 0)
+      break;
+    // fall through
+  case T_ILLOP:
+  case T_GPFLT:
+    // sysenter on a CPU without it: do what it would have done.
+    if(proc && (tf->cs&3) == DPL_USER && tf->eip + 2 <= proc->sz &&
+       *(ushort*)tf->eip == SYSENTER){
+      tf->eip = tf->edx;
+      tf->esp = tf->ecx;
+      fastsyscall(tf);
+      return;
+    }
+    // fall through
   default:
+    if(tf->trapno == T_DEBUG && tf->eip == (uint)sysentry){
+      // sysenter does not clear the trap flag; a user program
+      // that set it lands here.  Stop single-stepping.
+      tf->eflags &= ~FL_TF;
+      return;
+    }
+    if(virtioirq && tf->trapno == T_IRQ0 + virtioirq){
+      virtiointr();
+      lapiceoi();
+      break;
+    }
     if(proc == 0 || (tf->cs&3) == 0){
       // In kernel, it must be our mistake.
       cprintf("unexpected trap %d from cpu %d eip %x (cr2=0x%x)\n",
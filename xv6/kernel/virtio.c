@@ -0,0 +1,262 @@
+// Driver for the legacy PCI virtio block device, as provided by
+// qemu -drive file=fs.img,if=virtio.
+//
+// Unlike the IDE driver, which runs one request at a time, every
+// request becomes its own descriptor chain in the virtqueue, so
+// each process reading or writing a buf has its request in flight
+// at the same time and the device may complete them in any order.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "traps.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "buf.h"
+#include "pci.h"
+#include "virtio.h"
+
+#define QMAX   256   // largest device queue size we have memory for
+#define NDESC   64   // descriptors we actually hand out
+
+// The legacy interface fixes the queue layout: descriptors, then the
+// available ring, then the used ring on the next page boundary.
+// The whole queue must be physically contiguous.
+static char qmem[3*PGSIZE] __attribute__((aligned(PGSIZE)));
+
+static struct {
+  struct spinlock lock;
+  ushort iobase;
+  int qsize;          // queue size chosen by the device
+  int ndesc;          // min(qsize, NDESC)
+
+  struct vring_desc *desc;
+  struct vring_avail *avail;
+  struct vring_used *used;
+
+  char free[NDESC];   // is a descriptor free?
+  ushort usedidx;     // we've looked this far in used->ring
+
+  // Per in-flight request, indexed by the first descriptor of its chain.
+  struct {
+    struct buf *b;
+    uchar status;
+  } info[NDESC];
+  struct virtio_blk_req ops[NDESC];
+} vdisk;
+
+int virtioirq;        // interrupt line, 0 if there is no device
+
+void
+virtioinit(void)
+{
+  struct pcidev d;
+  int i, status;
+  uint avsz;
+
+  initlock(&vdisk.lock, "virtio");
+  if(pcifindid(VIRTIO_VENDOR, VIRTIO_DEV_BLK, &d) < 0)
+    return;
+  if(!(d.bar[0] & PCI_BAR_IO))
+    return;
+  pcienable(&d);
+  vdisk.iobase = d.bar[0] & ~3;
+
+  // Reset, then tell the device we have found it and can drive it.
+  status = 0;
+  outb(vdisk.iobase+VIRTIO_STATUS, status);
+  status |= VIRTIO_S_ACK;
+  outb(vdisk.iobase+VIRTIO_STATUS, status);
+  status |= VIRTIO_S_DRIVER;
+  outb(vdisk.iobase+VIRTIO_STATUS, status);
+
+  // We use none of the optional features.
+  inl(vdisk.iobase+VIRTIO_HOST_FEATURES);
+  outl(vdisk.iobase+VIRTIO_GUEST_FEATURES, 0);
+
+  // Set up queue 0.
+  outw(vdisk.iobase+VIRTIO_QUEUE_SEL, 0);
+  vdisk.qsize = inw(vdisk.iobase+VIRTIO_QUEUE_SIZE);
+  if(vdisk.qsize == 0 || vdisk.qsize > QMAX){
+    cprintf("virtio: bad queue size %d\n", vdisk.qsize);
+    outb(vdisk.iobase+VIRTIO_STATUS, status | VIRTIO_S_FAILED);
+    return;
+  }
+  vdisk.ndesc = vdisk.qsize < NDESC ? vdisk.qsize : NDESC;
+  avsz = sizeof(struct vring_desc)*vdisk.qsize + 2*(3 + vdisk.qsize);
+  memset(qmem, 0, sizeof(qmem));
+  vdisk.desc = (struct vring_desc*)qmem;
+  vdisk.avail = (struct vring_avail*)(qmem +
+                sizeof(struct vring_desc)*vdisk.qsize);
+  vdisk.used = (struct vring_used*)(qmem + PGROUNDUP(avsz));
+  outl(vdisk.iobase+VIRTIO_QUEUE_PFN, PADDR(qmem) >> PGSHIFT);
+
+  for(i = 0; i < vdisk.ndesc; i++)
+    vdisk.free[i] = 1;
+
+  virtioirq = d.irq;
+  picenable(virtioirq);
+  ioapicenable(virtioirq, ncpu - 1);
+
+  outb(vdisk.iobase+VIRTIO_STATUS, status | VIRTIO_S_DRIVER_OK);
+  cprintf("virtio: disk at 0x%x irq %d queue %d\n",
+          vdisk.iobase, virtioirq, vdisk.qsize);
+}
+
+// Find a free descriptor, mark it non-free, return its index.
+static int
+alloc_desc(void)
+{
+  int i;
+
+  for(i = 0; i < vdisk.ndesc; i++){
+    if(vdisk.free[i]){
+      vdisk.free[i] = 0;
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void
+free_desc(int i)
+{
+  if(i >= vdisk.ndesc || vdisk.free[i])
+    panic("virtio free_desc");
+  vdisk.desc[i].addr = 0;
+  vdisk.desc[i].len = 0;
+  vdisk.desc[i].flags = 0;
+  vdisk.desc[i].next = 0;
+  vdisk.free[i] = 1;
+  wakeup(&vdisk.free[0]);
+}
+
+// Free a chain of descriptors.
+static void
+free_chain(int i)
+{
+  int flag, next;
+
+  for(;;){
+    flag = vdisk.desc[i].flags;
+    next = vdisk.desc[i].next;
+    free_desc(i);
+    if(!(flag & VRING_DESC_F_NEXT))
+      break;
+    i = next;
+  }
+}
+
+// Allocate three descriptors; they need not be contiguous.
+static int
+alloc3_desc(int *idx)
+{
+  int i, j;
+
+  for(i = 0; i < 3; i++){
+    idx[i] = alloc_desc();
+    if(idx[i] < 0){
+      for(j = 0; j < i; j++)
+        free_desc(idx[j]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Sync buf with the virtio disk, with the same contract as iderw.
+void
+virtiorw(struct buf *b)
+{
+  int idx[3], write;
+  struct virtio_blk_req *req;
+
+  if(!(b->flags & B_BUSY))
+    panic("virtiorw: buf not busy");
+  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
+    panic("virtiorw: nothing to do");
+  if(virtioirq == 0)
+    panic("virtiorw: no virtio disk");
+
+  write = (b->flags & B_DIRTY) != 0;
+
+  acquire(&vdisk.lock);
+
+  while(alloc3_desc(idx) < 0)
+    sleep(&vdisk.free[0], &vdisk.lock);
+
+  req = &vdisk.ops[idx[0]];
+  req->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  req->reserved = 0;
+  req->sector = b->blockno * (BSIZE/SECTSIZE);
+  req->sectorhi = 0;
+
+  vdisk.desc[idx[0]].addr = PADDR(req);
+  vdisk.desc[idx[0]].len = sizeof(*req);
+  vdisk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
+  vdisk.desc[idx[0]].next = idx[1];
+
+  vdisk.desc[idx[1]].addr = PADDR(b->data);
+  vdisk.desc[idx[1]].len = sizeof(b->data);
+  vdisk.desc[idx[1]].flags = VRING_DESC_F_NEXT;
+  if(!write)
+    vdisk.desc[idx[1]].flags |= VRING_DESC_F_WRITE;
+  vdisk.desc[idx[1]].next = idx[2];
+
+  vdisk.info[idx[0]].status = 0xff;  // device writes 0 on success
+  vdisk.desc[idx[2]].addr = PADDR(&vdisk.info[idx[0]].status);
+  vdisk.desc[idx[2]].len = 1;
+  vdisk.desc[idx[2]].flags = VRING_DESC_F_WRITE;
+  vdisk.desc[idx[2]].next = 0;
+
+  vdisk.info[idx[0]].b = b;
+
+  // Offer the chain, then publish the new avail index.
+  vdisk.avail->ring[vdisk.avail->idx % vdisk.qsize] = idx[0];
+  __sync_synchronize();
+  vdisk.avail->idx++;
+  __sync_synchronize();
+  outw(vdisk.iobase+VIRTIO_QUEUE_NOTIFY, 0);
+
+  // Wait for virtiointr() to say the request has finished.
+  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID)
+    sleep(b, &vdisk.lock);
+
+  vdisk.info[idx[0]].b = 0;
+  free_chain(idx[0]);
+
+  release(&vdisk.lock);
+}
+
+// Interrupt handler: complete every request the device has returned.
+void
+virtiointr(void)
+{
+  int id;
+  struct buf *b;
+
+  acquire(&vdisk.lock);
+
+  // Reading the ISR acknowledges the interrupt.
+  inb(vdisk.iobase+VIRTIO_ISR);
+
+  __sync_synchronize();
+  while(vdisk.usedidx != vdisk.used->idx){
+    __sync_synchronize();
+    id = vdisk.used->ring[vdisk.usedidx % vdisk.qsize].id;
+    if(vdisk.info[id].status != 0)
+      panic("virtiointr status");
+
+    b = vdisk.info[id].b;
+    b->flags |= B_VALID;
+    b->flags &= ~B_DIRTY;
+    wakeup(b);
+
+    vdisk.usedidx++;
+  }
+
+  release(&vdisk.lock);
+}
@@ -0,0 +1,64 @@
+#ifndef _VIRTIO_H_
+#define _VIRTIO_H_
+// Legacy (virtio 0.9.5) PCI virtio device and virtqueue layout.
+// http://ozlabs.org/~rusty/virtio-spec/virtio-0.9.5.pdf
+
+#define VIRTIO_VENDOR        0x1AF4
+#define VIRTIO_DEV_BLK       0x1001   // transitional block device
+
+// I/O port registers, relative to BAR0.
+#define VIRTIO_HOST_FEATURES  0x00   // 32 bits, read only
+#define VIRTIO_GUEST_FEATURES 0x04   // 32 bits
+#define VIRTIO_QUEUE_PFN      0x08   // 32 bits, page number of the queue
+#define VIRTIO_QUEUE_SIZE     0x0C   // 16 bits, read only
+#define VIRTIO_QUEUE_SEL      0x0E   // 16 bits
+#define VIRTIO_QUEUE_NOTIFY   0x10   // 16 bits
+#define VIRTIO_STATUS         0x12   // 8 bits
+  #define VIRTIO_S_ACK          0x01
+  #define VIRTIO_S_DRIVER       0x02
+  #define VIRTIO_S_DRIVER_OK    0x04
+  #define VIRTIO_S_FAILED       0x80
+#define VIRTIO_ISR            0x13   // 8 bits, reading acknowledges
+
+// Virtqueue descriptor.
+struct vring_desc {
+  uint addr;      // physical address (low 32 bits)
+  uint addrhi;    // high 32 bits, always 0 here
+  uint len;
+  ushort flags;
+  ushort next;
+};
+#define VRING_DESC_F_NEXT   1   // chained with another descriptor
+#define VRING_DESC_F_WRITE  2   // device writes (vs reads)
+
+// Ring of descriptor chain heads offered to the device.
+struct vring_avail {
+  ushort flags;
+  ushort idx;
+  ushort ring[];
+};
+
+struct vring_used_elem {
+  uint id;        // head of the completed descriptor chain
+  uint len;
+};
+
+// Ring of descriptor chains the device has finished with.
+struct vring_used {
+  ushort flags;
+  ushort idx;
+  struct vring_used_elem ring[];
+};
+
+// Header of a virtio-blk request; the data buffer and
+// a one-byte status follow in separate descriptors.
+struct virtio_blk_req {
+  uint type;
+  uint reserved;
+  uint sector;    // in SECTSIZE units (low 32 bits)
+  uint sectorhi;
+};
+#define VIRTIO_BLK_T_IN   0   // read
+#define VIRTIO_BLK_T_OUT  1   // write
+
+#endif // _VIRTIO_H_
@@ -5,6 +5,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "vdata.h"
 
 extern char data[];  // defined in data.S
 
@@ -38,6 +39,10 @@ seginit(void)
   // Map cpu, and curproc
   c->gdt[SEG_KCPU] = SEG(STA_W, &c->cpu, 8, 0);
 
+  // Let user code find out which CPU it is on, with lsl.
+  c->gdt[SEG_UCPU] = SEG16(0, 0, c - cpus, DPL_USER);
+  vdata->ncpu = ncpu;
+
   lgdt(c->gdt, sizeof(c->gdt));
   loadgs(SEG_KCPU << 3);
   
@@ -49,7 +54,7 @@ seginit(void)
 // Return the address of the PTE in page table pgdir
 // that corresponds to linear address va.  If create!=0,
 // create any required page table pages.
-static pte_t *
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int create)
 {
   pde_t *pde;
@@ -74,7 +79,7 @@ walkpgdir(pde_t *pgdir, const void *va, int create)
 // Create PTEs for linear addresses starting at la that refer to
 // physical addresses starting at pa. la and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *la, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -107,7 +112,8 @@ mappages(pde_t *pgdir, void *la, uint size, uint pa, int perm)
 // 
 // setupkvm() and exec() set up every page table like this:
 //   0..640K          : user memory (text, data, stack, heap)
-//   640K..1M         : mapped direct (for IO space)
+//   640K..644K       : vdata page, read-only to user (VDATA)
+//   644K..1M         : mapped direct (for IO space)
 //   1M..end          : mapped direct (for the kernel's text and data)
 //   end..PHYSTOP     : mapped direct (kernel heap and user pages)
 //   0xfe000000..0    : mapped direct (devices such as ioapic)
@@ -124,12 +130,16 @@ static struct kmap {
   void *e;
   int perm;
 } kmap[] = {
-  {(void*)USERTOP,    (void*)0x100000, PTE_W},  // I/O space
+  {(void*)VDATA+PGSIZE, (void*)0x100000, PTE_W},  // I/O space
   {(void*)0x100000,   data,            0    },  // kernel text, rodata
   {data,              (void*)PHYSTOP,  PTE_W},  // kernel data, memory
   {(void*)0xFE000000, 0,               PTE_W},  // device mappings
 };
 
+// The page mapped at VDATA, which the kernel updates in place.
+static char vpage[PGSIZE] __attribute__((aligned(PGSIZE)));
+struct vdata *vdata = (struct vdata*)vpage;
+
 // Set up kernel part of a page table.
 pde_t*
 setupkvm(void)
@@ -144,6 +154,8 @@ setupkvm(void)
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
     if(mappages(pgdir, k->p, k->e - k->p, (uint)k->p, k->perm) < 0)
       return 0;
+  if(mappages(pgdir, (void*)VDATA, PGSIZE, PADDR(vpage), PTE_U) < 0)
+    return 0;
 
   return pgdir;
 }
@@ -178,6 +190,8 @@ switchuvm(struct proc *p)
   cpu->ts.ss0 = SEG_KDATA << 3;
   cpu->ts.esp0 = (uint)proc->kstack + KSTACKSIZE;
   ltr(SEG_TSS << 3);
+  if(cpu->sysenter)
+    wrmsr(MSR_SYSENTER_ESP, cpu->ts.esp0);
   if(p->pgdir == 0)
     panic("switchuvm: no pgdir");
   lcr3(PADDR(p->pgdir));  // switch to new address space
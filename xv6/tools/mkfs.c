@@ -11,21 +11,26 @@
 
 #define stat xv6_stat  // avoid clash with host struct stat
 #define dirent xv6_dirent  // avoid clash with host struct stat
+#undef BSIZE
+#define BSIZE bsize  // block size is chosen at run time, see -b
 #include "types.h"
 #include "fs.h"
 #include "stat.h"
+#include "param.h"
 #undef stat
 #undef dirent
 
-#define BLOCK_SIZE (512)
+#define MAXBSIZE 2048
 
-int nblocks = 995;
+uint bsize = FSBSIZE;
+int nblocks;
+int nlog;
 int ninodes = 200;
 int size = 1024;
 
 int fsfd;
 struct superblock sb;
-char zeroes[512];
+char zeroes[MAXBSIZE];
 uint freeblock;
 uint usedblocks;
 uint bitblocks;
@@ -39,6 +44,7 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+uint bmap(struct dinode *din, uint fbn);
 
 // convert to intel byte order
 ushort
@@ -65,21 +71,26 @@ xint(uint x)
 
 
 int 
-mkfs(int nblocks, int ninodes, int size) {
+mkfs(int ninodes, int size) {
 
   int i;
-  char buf[BLOCK_SIZE];
+  char buf[MAXBSIZE];
+
+  bitblocks = size/(bsize*8) + 1;
+  nlog = LOGSIZE + 1;  // header plus logged blocks
+  usedblocks = ninodes / IPB + 3 + bitblocks + nlog;
+  freeblock = usedblocks;
+  nblocks = size - usedblocks;
 
   sb.size = xint(size);
-  sb.nblocks = xint(nblocks); // so whole disk is size sectors
+  sb.nblocks = xint(nblocks); // so whole disk is size blocks
   sb.ninodes = xint(ninodes);
+  sb.bsize = xint(bsize);
+  sb.nlog = xint(nlog);
+  sb.logstart = xint(ninodes / IPB + 3 + bitblocks);
 
-  bitblocks = size/(512*8) + 1;
-  usedblocks = ninodes / IPB + 3 + bitblocks;
-  freeblock = usedblocks;
-
-  printf("used %d (bit %d ninode %zu) free %u total %d\n", usedblocks,
-         bitblocks, ninodes/IPB + 1, freeblock, nblocks+usedblocks);
+  printf("used %d (bit %d ninode %zu log %d) free %u total %d\n", usedblocks,
+         bitblocks, ninodes/IPB + 1, nlog, freeblock, nblocks+usedblocks);
 
   assert(nblocks + usedblocks == size);
 
@@ -105,7 +116,7 @@ add_dir(DIR *cur_dir, int cur_inode, int parent_inode) {
 	struct dirent *entry;
 	struct stat st;
 	int bytes_read;
-	char buf[BLOCK_SIZE];
+	char buf[MAXBSIZE];
 	int off;
 
 	bzero(&de, sizeof(de));
@@ -173,7 +184,7 @@ add_dir(DIR *cur_dir, int cur_inode, int parent_inode) {
 			bytes_read = 0;
 	  		child_inode = ialloc(T_FILE);
 			bzero(&de, sizeof(de));
-			while((bytes_read = read(child_fd, buf, sizeof(buf))) > 0) {
+			while((bytes_read = read(child_fd, buf, bsize)) > 0) {
 				iappend(child_inode, buf, bytes_read);
 			}
 		}
@@ -203,13 +214,22 @@ main(int argc, char *argv[])
   int r;
   DIR *root_dir;
 
+  if(argc >= 3 && strcmp(argv[1], "-b") == 0){
+    bsize = atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-b blocksize] fs.img files...\n");
+    exit(1);
+  }
+  if(bsize != 512 && bsize != 1024 && bsize != 2048){
+    fprintf(stderr, "mkfs: block size must be 512, 1024 or 2048\n");
     exit(1);
   }
 
-  assert((512 % sizeof(struct dinode)) == 0);
-  assert((512 % sizeof(struct xv6_dirent)) == 0);
+  assert((bsize % sizeof(struct dinode)) == 0);
+  assert((bsize % sizeof(struct xv6_dirent)) == 0);
 
   fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
   if(fsfd < 0){
@@ -217,7 +237,7 @@ main(int argc, char *argv[])
     exit(1);
   }
 
-  mkfs(995, 200, 1024);
+  mkfs(200, 1024);
 
   root_dir = opendir(argv[2]);
 
@@ -237,11 +257,11 @@ main(int argc, char *argv[])
 void
 wsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * 512L, 0) != sec * 512L){
+  if(lseek(fsfd, sec * (long)bsize, 0) != sec * (long)bsize){
     perror("lseek");
     exit(1);
   }
-  if(write(fsfd, buf, 512) != 512){
+  if(write(fsfd, buf, bsize) != bsize){
     perror("write");
     exit(1);
   }
@@ -256,7 +276,7 @@ i2b(uint inum)
 void
 winode(uint inum, struct dinode *ip)
 {
-  char buf[512];
+  char buf[MAXBSIZE];
   uint bn;
   struct dinode *dip;
 
@@ -270,7 +290,7 @@ winode(uint inum, struct dinode *ip)
 void
 rinode(uint inum, struct dinode *ip)
 {
-  char buf[512];
+  char buf[MAXBSIZE];
   uint bn;
   struct dinode *dip;
 
@@ -283,11 +303,11 @@ rinode(uint inum, struct dinode *ip)
 void
 rsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * 512L, 0) != sec * 512L){
+  if(lseek(fsfd, sec * (long)bsize, 0) != sec * (long)bsize){
     perror("lseek");
     exit(1);
   }
-  if(read(fsfd, buf, 512) != 512){
+  if(read(fsfd, buf, bsize) != bsize){
     perror("read");
     exit(1);
   }
@@ -310,12 +330,12 @@ ialloc(ushort type)
 void
 balloc(int used)
 {
-  uchar buf[512];
+  uchar buf[MAXBSIZE];
   int i;
 
   printf("balloc: first %d blocks have been allocated\n", used);
-  assert(used < 512*8);
-  bzero(buf, 512);
+  assert(used < bsize*8);
+  bzero(buf, bsize);
   for(i = 0; i < used; i++){
     buf[i/8] = buf[i/8] | (0x1 << (i%8));
   }
@@ -325,46 +345,82 @@ balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the disk block holding file block fbn of din, allocating
+// it from freeblock if needed.  Same layout as bmap in the kernel:
+// extents first, growing the last one while blocks stay contiguous,
+// then the double-indirect tree.
+uint
+bmap(struct dinode *din, uint fbn)
+{
+  int i;
+  uint bn, start, len;
+  uint dind[NINDIRECT], ind[NINDIRECT];
+
+  bn = fbn;
+  for(i = 0; i < NEXTENT && xint(din->extents[i].len) > 0; i++){
+    len = xint(din->extents[i].len);
+    if(bn < len)
+      return xint(din->extents[i].start) + bn;
+    bn -= len;
+  }
+
+  if(xint(din->dindirect) == 0 && bn == 0){
+    if(i > 0){
+      start = xint(din->extents[i-1].start);
+      len = xint(din->extents[i-1].len);
+      if(start + len == freeblock){
+        din->extents[i-1].len = xint(len + 1);
+        usedblocks++;
+        return freeblock++;
+      }
+    }
+    if(i < NEXTENT){
+      din->extents[i].start = xint(freeblock);
+      din->extents[i].len = xint(1);
+      usedblocks++;
+      return freeblock++;
+    }
+  }
+
+  assert(bn < NDINDIRECT);
+  if(xint(din->dindirect) == 0){
+    din->dindirect = xint(freeblock++);
+    usedblocks++;
+  }
+  rsect(xint(din->dindirect), (char*)dind);
+  if(dind[bn / NINDIRECT] == 0){
+    dind[bn / NINDIRECT] = xint(freeblock++);
+    usedblocks++;
+    wsect(xint(din->dindirect), (char*)dind);
+  }
+  rsect(xint(dind[bn / NINDIRECT]), (char*)ind);
+  if(ind[bn % NINDIRECT] == 0){
+    ind[bn % NINDIRECT] = xint(freeblock++);
+    usedblocks++;
+    wsect(xint(dind[bn / NINDIRECT]), (char*)ind);
+  }
+  return xint(ind[bn % NINDIRECT]);
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
   char *p = (char*)xp;
   uint fbn, off, n1;
   struct dinode din;
-  char buf[512];
-  uint indirect[NINDIRECT];
+  char buf[MAXBSIZE];
   uint x;
 
   rinode(inum, &din);
 
   off = xint(din.size);
   while(n > 0){
-    fbn = off / 512;
+    fbn = off / bsize;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-        usedblocks++;
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        // printf("allocate indirect block\n");
-        din.addrs[NDIRECT] = xint(freeblock++);
-        usedblocks++;
-      }
-      // printf("read indirect block\n");
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        usedblocks++;
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
-    n1 = min(n, (fbn + 1) * 512 - off);
+    x = bmap(&din, fbn);
+    n1 = min(n, (fbn + 1) * bsize - off);
     rsect(x, buf);
-    bcopy(p, buf + off - (fbn * 512), n1);
+    bcopy(p, buf + off - (fbn * bsize), n1);
     wsect(x, buf);
     n -= n1;
     off += n1;
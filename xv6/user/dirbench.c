@@ -0,0 +1,91 @@
+// Time creating, looking up and removing many names in one
+// directory.  The names are all links to a single file, so the
+// benchmark needs only one inode.
+//
+// usage: dirbench [nfiles]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define DIR "dirbench.d"
+
+char path[32];
+
+// Build the path DIR/fNNNNN for entry i.
+char*
+entry(int i)
+{
+  char *p;
+  int n;
+
+  strcpy(path, DIR "/f");
+  p = path + strlen(path);
+  for(n = 10000; n > 0; n /= 10)
+    *p++ = '0' + (i / n) % 10;
+  *p = 0;
+  return path;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, fd, nfiles, start;
+
+  nfiles = 10000;
+  if(argc > 1)
+    nfiles = atoi(argv[1]);
+
+  if(mkdir(DIR) < 0){
+    printf(2, "dirbench: mkdir %s failed\n", DIR);
+    exit();
+  }
+  if((fd = open(DIR "/target", O_CREATE|O_RDWR)) < 0){
+    printf(2, "dirbench: create target failed\n");
+    exit();
+  }
+  close(fd);
+
+  start = uptime();
+  for(i = 0; i < nfiles; i++){
+    if(link(DIR "/target", entry(i)) < 0){
+      printf(2, "dirbench: link %s failed\n", path);
+      exit();
+    }
+  }
+  printf(1, "create %d: %d ticks\n", nfiles, uptime() - start);
+
+  start = uptime();
+  for(i = 0; i < nfiles; i++){
+    if((fd = open(entry(i), O_RDONLY)) < 0){
+      printf(2, "dirbench: open %s failed\n", path);
+      exit();
+    }
+    close(fd);
+  }
+  printf(1, "lookup %d: %d ticks\n", nfiles, uptime() - start);
+
+  start = uptime();
+  for(i = 0; i < nfiles; i++){
+    if(open(entry(nfiles + i), O_RDONLY) >= 0){
+      printf(2, "dirbench: %s should not exist\n", path);
+      exit();
+    }
+  }
+  printf(1, "missing %d: %d ticks\n", nfiles, uptime() - start);
+
+  start = uptime();
+  for(i = 0; i < nfiles; i++){
+    if(unlink(entry(i)) < 0){
+      printf(2, "dirbench: unlink %s failed\n", path);
+      exit();
+    }
+  }
+  printf(1, "unlink %d: %d ticks\n", nfiles, uptime() - start);
+
+  unlink(DIR "/target");
+  if(unlink(DIR) < 0)
+    printf(2, "dirbench: %s not empty\n", DIR);
+  exit();
+}
@@ -2,6 +2,7 @@
 # user programs
 USER_PROGS := \
 	cat\
+	dirbench\
 	echo\
 	forktest\
 	grep\
@@ -10,9 +11,11 @@ USER_PROGS := \
 	ln\
 	ls\
 	mkdir\
+	ringbench\
 	rm\
 	sh\
 	stressfs\
+	sysbench\
 	tester\
 	usertests\
 	wc\
@@ -0,0 +1,136 @@
+// Compare small reads and writes made one system call at a time
+// with the same operations batched through ringenter.
+//
+// usage: ringbench [nops]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "ring.h"
+
+#define FILE "ringbench.f"
+#define RECSIZE 16
+
+struct ring ring;
+char rec[RECSIZE];
+
+// Queue one request; the ring must have room.
+void
+submit(int op, int fd, void *buf, int n)
+{
+  struct sqe *e;
+
+  e = &ring.sq[ring.sqtail % NRING];
+  e->op = op;
+  e->fd = fd;
+  e->buf = buf;
+  e->n = n;
+  e->off = -1;
+  e->data = ring.sqtail;
+  ring.sqtail++;
+}
+
+// Run everything queued and check every result is want.
+void
+reap(int want)
+{
+  struct cqe *c;
+
+  while(ring.sqhead != ring.sqtail){
+    if(ringenter(&ring) < 0){
+      printf(2, "ringbench: ringenter failed\n");
+      exit();
+    }
+    while(ring.cqhead != ring.cqtail){
+      c = &ring.cq[ring.cqhead % NRING];
+      if(c->res != want){
+        printf(2, "ringbench: request %d returned %d\n", c->data, c->res);
+        exit();
+      }
+      ring.cqhead++;
+    }
+  }
+}
+
+// Do n requests of one kind through the ring, NRING at a time.
+void
+batch(int op, int fd, int n, int want)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    submit(op, fd, rec, RECSIZE);
+    if(ring.sqtail - ring.sqhead == NRING)
+      reap(want);
+  }
+  reap(want);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, fd, nops, start, p[2];
+
+  nops = 1000;
+  if(argc > 1)
+    nops = atoi(argv[1]);
+  memset(rec, 'r', sizeof(rec));
+
+  if((fd = open(FILE, O_CREATE|O_RDWR)) < 0){
+    printf(2, "ringbench: create %s failed\n", FILE);
+    exit();
+  }
+  start = uptime();
+  for(i = 0; i < nops; i++){
+    if(write(fd, rec, RECSIZE) != RECSIZE){
+      printf(2, "ringbench: write failed\n");
+      exit();
+    }
+  }
+  printf(1, "write %d x %d: %d ticks\n", nops, RECSIZE, uptime() - start);
+  start = uptime();
+  batch(RING_WRITE, fd, nops, RECSIZE);
+  printf(1, "ring write %d x %d: %d ticks\n", nops, RECSIZE, uptime() - start);
+  close(fd);
+
+  fd = open(FILE, O_RDONLY);
+  start = uptime();
+  for(i = 0; i < nops; i++){
+    if(read(fd, rec, RECSIZE) != RECSIZE){
+      printf(2, "ringbench: read failed\n");
+      exit();
+    }
+  }
+  printf(1, "read %d x %d: %d ticks\n", nops, RECSIZE, uptime() - start);
+  start = uptime();
+  batch(RING_READ, fd, nops, RECSIZE);
+  printf(1, "ring read %d x %d: %d ticks\n", nops, RECSIZE, uptime() - start);
+  close(fd);
+  unlink(FILE);
+
+  // A pipe to ourselves: each write is read straight back.
+  if(pipe(p) < 0){
+    printf(2, "ringbench: pipe failed\n");
+    exit();
+  }
+  start = uptime();
+  for(i = 0; i < nops; i++){
+    if(write(p[1], rec, RECSIZE) != RECSIZE ||
+       read(p[0], rec, RECSIZE) != RECSIZE){
+      printf(2, "ringbench: pipe I/O failed\n");
+      exit();
+    }
+  }
+  printf(1, "pipe %d x %d: %d ticks\n", nops, RECSIZE, uptime() - start);
+  start = uptime();
+  for(i = 0; i < nops; i++){
+    submit(RING_WRITE, p[1], rec, RECSIZE);
+    submit(RING_READ, p[0], rec, RECSIZE);
+    if(ring.sqtail - ring.sqhead == NRING)
+      reap(RECSIZE);
+  }
+  reap(RECSIZE);
+  printf(1, "ring pipe %d x %d: %d ticks\n", nops, RECSIZE, uptime() - start);
+  exit();
+}
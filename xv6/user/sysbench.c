@@ -0,0 +1,56 @@
+// Time getpid through int $T_SYSCALL, through sysenter (the
+// way usys.S makes system calls), and through the vdata page
+// (the way ulib.c's getpid avoids making one).
+//
+// usage: sysbench [ncalls]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "syscall.h"
+#include "traps.h"
+
+// getpid, the old way.
+int
+intgetpid(void)
+{
+  int pid;
+
+  asm volatile("int %1" : "=a" (pid) : "i" (T_SYSCALL), "a" (SYS_getpid) : "memory");
+  return pid;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n;
+  uint start, t;
+
+  n = 100000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0){
+    printf(2, "usage: sysbench [ncalls]\n");
+    exit();
+  }
+
+  start = rdtsc();
+  for(i = 0; i < n; i++)
+    intgetpid();
+  t = rdtsc() - start;
+  printf(1, "int $T_SYSCALL: %d cycles/call\n", t / n);
+
+  start = rdtsc();
+  for(i = 0; i < n; i++)
+    sysgetpid();
+  t = rdtsc() - start;
+  printf(1, "sysenter: %d cycles/call\n", t / n);
+
+  start = rdtsc();
+  for(i = 0; i < n; i++)
+    getpid();
+  t = rdtsc() - start;
+  printf(1, "vdata: %d cycles/call\n", t / n);
+  exit();
+}
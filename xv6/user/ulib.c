@@ -3,6 +3,8 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "param.h"
+#include "vdata.h"
 
 char*
 strcpy(char *s, char *t)
@@ -103,3 +105,43 @@ memmove(void *vdst, void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Which CPU this process is running on, from the limit
+// of the segment the kernel sets up for it.
+static uint
+vcpunum(void)
+{
+  uint n;
+
+  asm volatile("lsl %1, %0" : "=r" (n) : "r" (VCPUSEL), "0" (NCPU) : "cc", "memory");
+  return n;
+}
+
+// getpid without a system call: the pid of the process running
+// on this CPU.  If the process moved, or something else ran,
+// between reading the CPU number and the pid, try again.
+int
+getpid(void)
+{
+  struct vdata *v;
+  uint c, n;
+  int pid;
+
+  v = (struct vdata*)VDATA;
+  for(;;){
+    c = vcpunum();
+    if(c >= NCPU)
+      return sysgetpid();
+    n = v->cpu[c].nswitch;
+    pid = v->cpu[c].pid;
+    if(vcpunum() == c && v->cpu[c].nswitch == n)
+      return pid;
+  }
+}
+
+// uptime without a system call.
+int
+uptime(void)
+{
+  return ((struct vdata*)VDATA)->ticks;
+}
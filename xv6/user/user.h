@@ -2,6 +2,9 @@
 #define _USER_H_
 
 struct stat;
+struct iovec;
+struct ring;
+struct timespec;
 
 // system calls
 int fork(void);
@@ -21,13 +24,24 @@ int link(char*, char*);
 int mkdir(char*);
 int chdir(char*);
 int dup(int);
-int getpid(void);
+int sysgetpid(void);
 char* sbrk(int);
 int sleep(int);
-int uptime(void);
+int sysuptime(void);
 int getprocs(void);
 int settickets(int tickets);
 int getpinfo(void *);
+int splice(int, int, int);
+int readv(int, struct iovec*, int);
+int writev(int, struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, void*, int, int);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int msync(void*, int);
+int ringenter(struct ring*);
+int nanosleep(struct timespec*);
+int clock_gettime(struct timespec*);
 
 // user library functions (ulib.c)
 int stat(char*, struct stat*);
@@ -42,6 +56,8 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+int getpid(void);
+int uptime(void);
 
 #endif // _USER_H_
 
@@ -3,6 +3,10 @@
 #include "user.h"
 #include "fs.h"
 #include "fcntl.h"
+#include "uio.h"
+#include "mman.h"
+#include "ring.h"
+#include "time.h"
 #include "syscall.h"
 #include "traps.h"
 
@@ -85,6 +89,8 @@ writetest(void)
   printf(stdout, "small file test ok\n");
 }
 
+#define BIGBLOCKS 300  // 150KB, well past what direct blocks alone could map
+
 void
 writetest1(void)
 {
@@ -98,7 +104,7 @@ writetest1(void)
     exit();
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGBLOCKS; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, 512) != 512){
       printf(stdout, "error: write big file failed\n", i);
@@ -118,7 +124,7 @@ writetest1(void)
   for(;;){
     i = read(fd, buf, 512);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != BIGBLOCKS){
         printf(stdout, "read only %d blocks from big", n);
         exit();
       }
@@ -253,6 +259,468 @@ pipe1(void)
   printf(1, "pipe1 ok\n");
 }
 
+// more data than the pipe holds, in writes and reads of
+// different sizes, so the copies wrap around the buffer
+void
+pipe2(void)
+{
+  int fds[2], pid;
+  int seq, i, n, total;
+
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  pid = fork();
+  seq = 0;
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < 20; n++){
+      for(i = 0; i < sizeof(buf); i++)
+        buf[i] = seq++;
+      if(write(fds[1], buf, sizeof(buf)) != sizeof(buf)){
+        printf(1, "pipe2 oops 1\n");
+        exit();
+      }
+    }
+    exit();
+  } else if(pid > 0){
+    close(fds[1]);
+    total = 0;
+    while((n = read(fds[0], buf, 777)) > 0){
+      for(i = 0; i < n; i++){
+        if((buf[i] & 0xff) != (seq++ & 0xff)){
+          printf(1, "pipe2 oops 2\n");
+          return;
+        }
+      }
+      total += n;
+    }
+    if(total != 20 * sizeof(buf))
+      printf(1, "pipe2 oops 3 total %d\n", total);
+    close(fds[0]);
+    wait();
+  } else {
+    printf(1, "fork() failed\n");
+    exit();
+  }
+  printf(1, "pipe2 ok\n");
+}
+
+// splice a file into a pipe, and that pipe into another
+void
+splicetest(void)
+{
+  int fd, p1[2], p2[2], pid;
+  int i, n, total;
+
+  printf(1, "splice test\n");
+  fd = open("splicef", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "splice create failed\n");
+    exit();
+  }
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i;
+  for(i = 0; i < 10; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(1, "splice write failed\n");
+      exit();
+    }
+  }
+  close(fd);
+
+  if(pipe(p1) != 0 || pipe(p2) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid == 0){
+    close(p1[1]);
+    close(p2[0]);
+    while((n = splice(p1[0], p2[1], 1000)) > 0)
+      ;
+    if(n < 0)
+      printf(1, "splice pipe to pipe failed\n");
+    exit();
+  } else if(pid < 0){
+    printf(1, "fork() failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid == 0){
+    close(p1[0]);
+    close(p2[0]);
+    close(p2[1]);
+    fd = open("splicef", 0);
+    total = 0;
+    while((n = splice(fd, p1[1], 3000)) > 0)
+      total += n;
+    if(n < 0 || total != 10 * sizeof(buf))
+      printf(1, "splice file to pipe failed %d\n", total);
+    if(splice(fd, fd, 1) != -1)
+      printf(1, "splice to a file should fail\n");
+    exit();
+  } else if(pid < 0){
+    printf(1, "fork() failed\n");
+    exit();
+  }
+  close(p1[0]);
+  close(p1[1]);
+  close(p2[1]);
+
+  total = 0;
+  while((n = read(p2[0], buf, 500)) > 0){
+    for(i = 0; i < n; i++){
+      if((buf[i] & 0xff) != ((total + i) % sizeof(buf) & 0xff)){
+        printf(1, "splice wrong data\n");
+        exit();
+      }
+    }
+    total += n;
+  }
+  if(total != 10 * sizeof(buf)){
+    printf(1, "splice short %d\n", total);
+    exit();
+  }
+  close(p2[0]);
+  wait();
+  wait();
+
+  // Two writers racing for one pipe must each splice all of
+  // the file: a full pipe is not the end of the file.
+  if(pipe(p1) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  for(i = 0; i < 2; i++){
+    pid = fork();
+    if(pid == 0){
+      close(p1[0]);
+      fd = open("splicef", 0);
+      total = 0;
+      while((n = splice(fd, p1[1], 3000)) > 0)
+        total += n;
+      if(n < 0 || total != 10 * sizeof(buf))
+        printf(1, "splice racing writer short %d\n", total);
+      exit();
+    } else if(pid < 0){
+      printf(1, "fork() failed\n");
+      exit();
+    }
+  }
+  close(p1[1]);
+  total = 0;
+  while((n = read(p1[0], buf, sizeof(buf))) > 0)
+    total += n;
+  close(p1[0]);
+  wait();
+  wait();
+  if(total != 2 * 10 * sizeof(buf)){
+    printf(1, "splice two writers short %d\n", total);
+    exit();
+  }
+  unlink("splicef");
+  printf(1, "splice ok\n");
+}
+
+// vectored and positional reads and writes
+void
+iovtest(void)
+{
+  int fd, i, n;
+  struct iovec iov[3];
+  char a[10], b[600], c[5];
+
+  printf(1, "iov test\n");
+  fd = open("iovf", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "iov create failed\n");
+    exit();
+  }
+  memset(a, 'a', sizeof(a));
+  memset(b, 'b', sizeof(b));
+  memset(c, 'c', sizeof(c));
+  iov[0].base = a;
+  iov[0].len = sizeof(a);
+  iov[1].base = b;
+  iov[1].len = sizeof(b);
+  iov[2].base = c;
+  iov[2].len = sizeof(c);
+  if(writev(fd, iov, 3) != 615){
+    printf(1, "writev failed\n");
+    exit();
+  }
+  if(pwrite(fd, "XY", 2, 9) != 2){
+    printf(1, "pwrite failed\n");
+    exit();
+  }
+  // pwrite must not have moved the offset
+  if(write(fd, "d", 1) != 1){
+    printf(1, "write after pwrite failed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("iovf", O_RDONLY);
+  if(pread(fd, buf, 4, 8) != 4 || buf[0] != 'a' || buf[1] != 'X' ||
+     buf[2] != 'Y' || buf[3] != 'b'){
+    printf(1, "pread failed\n");
+    exit();
+  }
+  memset(buf, 0, sizeof(buf));
+  iov[0].base = buf;
+  iov[0].len = 11;
+  iov[1].base = buf + 100;
+  iov[1].len = 1000;
+  n = readv(fd, iov, 2);
+  if(n != 616 || buf[9] != 'X' || buf[10] != 'Y' || buf[100] != 'b'){
+    printf(1, "readv failed %d\n", n);
+    exit();
+  }
+  for(i = 100; i < 100 + 599; i++){
+    if(buf[i] != 'b'){
+      printf(1, "readv wrong data\n");
+      exit();
+    }
+  }
+  if(buf[699] != 'c' || buf[703] != 'c' || buf[704] != 'd'){
+    printf(1, "readv wrong tail\n");
+    exit();
+  }
+  iov[0].base = (void*)0xffffff00;
+  if(readv(fd, iov, 2) != -1){
+    printf(1, "readv accepted a bad iovec\n");
+    exit();
+  }
+  close(fd);
+  unlink("iovf");
+  printf(1, "iov ok\n");
+}
+
+// map a file private and shared, and write through the mapping
+void
+mmaptest(void)
+{
+  int fd, i, pid;
+  char *p;
+
+  printf(1, "mmap test\n");
+  fd = open("mmapf", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "mmap create failed\n");
+    exit();
+  }
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i;
+  for(i = 0; i < 3; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(1, "mmap write failed\n");
+      exit();
+    }
+  }
+
+  // Private: see the file, keep changes to ourselves.
+  p = mmap(0, 3*sizeof(buf), PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED){
+    printf(1, "mmap private failed\n");
+    exit();
+  }
+  for(i = 0; i < 3*sizeof(buf); i++){
+    if(p[i] != (char)i){
+      printf(1, "mmap wrong data at %d\n", i);
+      exit();
+    }
+  }
+  p[0] = 'P';
+  pid = fork();
+  if(pid == 0){
+    if(p[0] != 'P' || p[1] != 1)
+      printf(1, "mmap child lost private page\n");
+    exit();
+  }
+  wait();
+  // The kernel can use mapped memory as a buffer.
+  if(pwrite(fd, p + 1, 1, 100) != 1 || munmap(p, 3*sizeof(buf)) < 0){
+    printf(1, "mmap munmap private failed\n");
+    exit();
+  }
+  if(pread(fd, buf, 101, 0) != 101 || buf[0] != 0 || buf[100] != 1){
+    printf(1, "mmap private change reached the file\n");
+    exit();
+  }
+
+  // Shared: changes reach the file on munmap.
+  p = mmap(0, 3*sizeof(buf), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED){
+    printf(1, "mmap shared failed\n");
+    exit();
+  }
+  p[0] = 'S';
+  p[5000] = 'T';
+  if(msync(p, 1) < 0 || pread(fd, buf, 1, 0) != 1 || buf[0] != 'S'){
+    printf(1, "msync failed\n");
+    exit();
+  }
+  if(munmap(p, 3*sizeof(buf)) < 0){
+    printf(1, "mmap munmap shared failed\n");
+    exit();
+  }
+  if(pread(fd, buf, 1, 5000) != 1 || buf[0] != 'T'){
+    printf(1, "mmap shared change lost\n");
+    exit();
+  }
+  close(fd);
+
+  // Shared writable needs a writable file.
+  fd = open("mmapf", O_RDONLY);
+  if(mmap(0, 100, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) != MAP_FAILED){
+    printf(1, "mmap of read-only file for writing succeeded\n");
+    exit();
+  }
+
+  // Nor may the kernel write a read-only mapping on our behalf,
+  // shared or private.
+  for(i = 0; i < 2; i++){
+    p = mmap(0, 3*sizeof(buf), PROT_READ, i ? MAP_PRIVATE : MAP_SHARED,
+             fd, 0);
+    if(p == MAP_FAILED){
+      printf(1, "mmap read-only failed\n");
+      exit();
+    }
+    if(pread(fd, p, 1, 5000) != -1 || fstat(fd, (struct stat*)p) != -1){
+      printf(1, "mmap kernel wrote a read-only mapping\n");
+      exit();
+    }
+    if(p[0] != 'S' || munmap(p, 3*sizeof(buf)) < 0){
+      printf(1, "mmap read-only mapping changed\n");
+      exit();
+    }
+  }
+  if(pread(fd, buf, 1, 0) != 1 || buf[0] != 'S'){
+    printf(1, "mmap read-only file changed\n");
+    exit();
+  }
+  close(fd);
+  unlink("mmapf");
+  printf(1, "mmap ok\n");
+}
+
+// open, write, read and close through one submission ring
+void
+ringtest(void)
+{
+  static struct ring r;
+  struct sqe *e;
+  int i, fd;
+  char b[8];
+
+  printf(1, "ring test\n");
+  e = r.sq;
+  e[0].op = RING_OPEN;
+  e[0].buf = "ringf";
+  e[0].n = O_CREATE|O_RDWR;
+  e[0].data = 100;
+  r.sqtail = 1;
+  if(ringenter(&r) != 1 || r.cqtail != 1 || r.cq[0].data != 100 ||
+     (fd = r.cq[0].res) < 0){
+    printf(1, "ring open failed\n");
+    exit();
+  }
+  r.cqhead = 1;
+
+  for(i = 1; i <= 4; i++){
+    e[i].fd = fd;
+    e[i].n = 4;
+    e[i].data = i;
+  }
+  e[1].op = RING_WRITE;
+  e[1].buf = "abcd";
+  e[1].off = -1;
+  e[2].op = RING_WRITE;
+  e[2].buf = "efgh";
+  e[2].off = -1;
+  e[3].op = RING_READ;
+  e[3].buf = b;
+  e[3].off = 2;
+  e[4].op = RING_CLOSE;
+  e[5].op = RING_READ;
+  e[5].fd = fd;
+  e[5].buf = b + 4;
+  e[5].n = 4;
+  e[5].off = -1;
+  r.sqtail = 6;
+  if(ringenter(&r) != 5 || r.cqtail != 6){
+    printf(1, "ring batch failed\n");
+    exit();
+  }
+  if(r.cq[1].res != 4 || r.cq[2].res != 4 || r.cq[3].res != 4 ||
+     r.cq[4].res != 0 || r.cq[5].res != -1 || b[0] != 'c' || b[3] != 'f'){
+    printf(1, "ring results wrong\n");
+    exit();
+  }
+  unlink("ringf");
+  printf(1, "ring ok\n");
+}
+
+// nanosleep sleeps at least as long as asked, less than a tick
+void
+nanotest(void)
+{
+  struct timespec t0, t1, ts;
+  uint ns;
+
+  printf(1, "nanosleep test\n");
+  ts.sec = 0;
+  ts.nsec = 2000000;
+  if(clock_gettime(&t0) < 0 || nanosleep(&ts) < 0 || clock_gettime(&t1) < 0){
+    printf(1, "nanosleep failed\n");
+    exit();
+  }
+  ns = (t1.sec - t0.sec)*1000000000 + t1.nsec - t0.nsec;
+  if(ns < 2000000){
+    printf(1, "nanosleep woke after %d ns\n", ns);
+    exit();
+  }
+  ts.nsec = 1000000000;
+  if(nanosleep(&ts) != -1){
+    printf(1, "nanosleep took bad nsec\n");
+    exit();
+  }
+  printf(1, "nanosleep ok\n");
+}
+
+// getpid and uptime from the vdata page agree with the kernel
+void
+vdatatest(void)
+{
+  int pid, t;
+
+  printf(1, "vdata test\n");
+  if(getpid() != sysgetpid()){
+    printf(1, "vdata getpid %d, kernel says %d\n", getpid(), sysgetpid());
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(getpid() != sysgetpid())
+      printf(1, "vdata getpid wrong in child\n");
+    exit();
+  }
+  wait();
+  t = uptime();
+  sleep(2);
+  if(uptime() < t + 2 || uptime() > sysuptime()){
+    printf(1, "vdata uptime wrong\n");
+    exit();
+  }
+  printf(1, "vdata ok\n");
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(void)
@@ -787,6 +1255,136 @@ bigdir(void)
   printf(1, "bigdir ok\n");
 }
 
+// mkfs writes lindir as a linear directory of two blocks.  Filling
+// a hole at the start of its second block must keep it linear and
+// lose none of its entries.
+void
+lindirtest(void)
+{
+  static struct dirent de[2*2048/sizeof(struct dirent)];
+  struct stat st;
+  char path[32];
+  int fd, i, n, hole;
+
+  printf(1, "lindir test\n");
+
+  fd = open("lindir", 0);
+  if(fd < 0 || fstat(fd, &st) < 0){
+    printf(1, "lindir open failed\n");
+    exit();
+  }
+  n = read(fd, de, sizeof(de));
+  close(fd);
+  if(n != st.size || n > sizeof(de)){
+    printf(1, "lindir read failed\n");
+    exit();
+  }
+  n /= sizeof(struct dirent);
+  hole = n / 2;
+  if(de[hole].inum == 0){
+    printf(1, "lindir is not two full blocks\n");
+    exit();
+  }
+
+  strcpy(path, "lindir/");
+  strcpy(path + 7, de[hole].name);
+  if(unlink(path) != 0){
+    printf(1, "lindir unlink %s failed\n", path);
+    exit();
+  }
+  fd = open(path, O_CREATE);
+  if(fd < 0){
+    printf(1, "lindir create %s failed\n", path);
+    exit();
+  }
+  close(fd);
+
+  for(i = 2; i < n; i++){
+    if(de[i].inum == 0)
+      continue;
+    strcpy(path + 7, de[i].name);
+    fd = open(path, 0);
+    if(fd < 0){
+      printf(1, "lindir lost %s\n", path);
+      exit();
+    }
+    close(fd);
+    if(unlink(path) != 0){
+      printf(1, "lindir unlink %s failed\n", path);
+      exit();
+    }
+  }
+  if(unlink("lindir") != 0){
+    printf(1, "lindir unlink lindir failed\n");
+    exit();
+  }
+  printf(1, "lindir ok\n");
+}
+
+// A directory that outgrows one block becomes hashed; entries
+// must stay reachable and the directory removable once emptied.
+void
+hashdir(void)
+{
+  int i, fd;
+  char name[10];
+
+  printf(1, "hashdir test\n");
+
+  if(mkdir("hd") != 0){
+    printf(1, "hashdir mkdir failed\n");
+    exit();
+  }
+  fd = open("hd/t", O_CREATE);
+  if(fd < 0){
+    printf(1, "hashdir create failed\n");
+    exit();
+  }
+  close(fd);
+
+  strcpy(name, "hd/x00");
+  for(i = 0; i < 300; i++){
+    name[4] = '0' + (i / 64);
+    name[5] = '0' + (i % 64);
+    if(link("hd/t", name) != 0){
+      printf(1, "hashdir link failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < 300; i++){
+    name[4] = '0' + (i / 64);
+    name[5] = '0' + (i % 64);
+    fd = open(name, 0);
+    if(fd < 0){
+      printf(1, "hashdir open %s failed\n", name);
+      exit();
+    }
+    close(fd);
+  }
+  if(unlink("hd") == 0){
+    printf(1, "hashdir unlink non-empty hd succeeded!\n");
+    exit();
+  }
+  for(i = 0; i < 300; i++){
+    name[4] = '0' + (i / 64);
+    name[5] = '0' + (i % 64);
+    if(unlink(name) != 0){
+      printf(1, "hashdir unlink failed\n");
+      exit();
+    }
+  }
+  if(open("hd/x00", 0) >= 0){
+    printf(1, "hashdir open removed name succeeded!\n");
+    exit();
+  }
+  unlink("hd/t");
+  if(unlink("hd") != 0){
+    printf(1, "hashdir unlink hd failed\n");
+    exit();
+  }
+  printf(1, "hashdir ok\n");
+}
+
 void
 subdir(void)
 {
@@ -1502,9 +2100,17 @@ main(int argc, char *argv[])
 
   mem();
   pipe1();
+  pipe2();
+  splicetest();
+  iovtest();
+  mmaptest();
+  ringtest();
+  nanotest();
+  vdatatest();
   preempt();
   exitwait();
 
+  lindirtest();
   rmdot();
   fourteen();
   bigfile();
@@ -1519,6 +2125,7 @@ main(int argc, char *argv[])
   iref();
   forktest();
   bigdir(); // slow
+  hashdir();
 
   exectest();
 